@@ -0,0 +1,97 @@
+// times the vectorized advert kernels in advert_kernels.h against their scalar fallbacks, and
+// checks that both give the same answers. needs no ns-3:
+//   g++ -std=c++17 -O2 -o advert_bench advert_bench.cpp && ./advert_bench
+// add -mavx2 for the AVX2 paths; otherwise x86-64 gets SSE2.
+// the exit status is nonzero if a vector kernel disagrees with the scalar one
+
+#include "peer_protocol.h"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <random>
+
+static const char* KernelName() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+int main() {
+    std::mt19937 rng(525);
+    std::uniform_int_distribution<int> byte(0, 255);
+    bool mismatch = false;
+
+    std::printf("# kernel=%s\n", KernelName());
+    std::printf("benchmark,n,scalar_ns,vector_ns\n");
+
+    // two adverts over the same elements, with the neighbor ahead on roughly one element in sixteen
+    for(size_t n : {16, 64, 256, 1024, 4096}) {
+        std::vector<uint8_t> ours, theirs;
+        for(size_t idx = 0; idx < n; idx++) {
+            causalNum_t version = byte(rng), round = byte(rng);
+            twoByteToOne((elementId_t)(3*idx), &ours);
+            ours.push_back(version);
+            ours.push_back(round);
+            if(byte(rng) < 16 && round < 255) {
+                round++;
+            }
+            twoByteToOne((elementId_t)(3*idx), &theirs);
+            theirs.push_back(version);
+            theirs.push_back(round);
+        }
+
+        std::vector<elementId_t> scalarAhead, vectorAhead;
+        scalarAhead.reserve(n);
+        vectorAhead.reserve(n);
+        size_t scalarMatched = CompareAdvertEntriesScalar(theirs.data(), ours.data(), n, &scalarAhead);
+        size_t vectorMatched = CompareAdvertEntries(theirs.data(), ours.data(), n, &vectorAhead);
+        if(scalarMatched != vectorMatched || scalarAhead != vectorAhead) {
+            std::fprintf(stderr, "advert compare disagrees at n=%zu\n", n);
+            mismatch = true;
+        }
+        // the element ids part ways partway through
+        theirs[4*(n/2)] ^= 1;
+        scalarAhead.clear();
+        vectorAhead.clear();
+        if(CompareAdvertEntriesScalar(theirs.data(), ours.data(), n, &scalarAhead) != CompareAdvertEntries(theirs.data(), ours.data(), n, &vectorAhead)
+            || scalarAhead != vectorAhead) {
+            std::fprintf(stderr, "advert compare disagrees on a diverging advert at n=%zu\n", n);
+            mismatch = true;
+        }
+        theirs[4*(n/2)] ^= 1;
+
+        double scalarNs = TimeCalls([&]() {
+            scalarAhead.clear();
+            CompareAdvertEntriesScalar(theirs.data(), ours.data(), n, &scalarAhead);
+        });
+        double vectorNs = TimeCalls([&]() {
+            vectorAhead.clear();
+            CompareAdvertEntries(theirs.data(), ours.data(), n, &vectorAhead);
+        });
+        std::printf("advert_compare,%zu,%.1f,%.1f\n", n, scalarNs, vectorNs);
+    }
+
+    // best (version, round) across a local group
+    for(size_t n : {4, 16, 64, 256, 1024}) {
+        std::vector<causalKey_t> keys(n);
+        for(causalKey_t &k : keys) {
+            k = causalKey(byte(rng), byte(rng));
+        }
+        if(MaxKeyIndexScalar(keys.data(), n) != MaxKeyIndex(keys.data(), n)) {
+            std::fprintf(stderr, "max key disagrees at n=%zu\n", n);
+            mismatch = true;
+        }
+
+        volatile size_t sink = 0;
+        double scalarNs = TimeCalls([&]() { sink = MaxKeyIndexScalar(keys.data(), n); });
+        double vectorNs = TimeCalls([&]() { sink = MaxKeyIndex(keys.data(), n); });
+        (void)sink;
+        std::printf("best_peer,%zu,%.1f,%.1f\n", n, scalarNs, vectorNs);
+    }
+
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#ifndef ADVERT_KERNELS_H
+#define ADVERT_KERNELS_H
+
+// batch comparisons over (version, round) pairs, with SSE2 and AVX2 versions picked at compile
+// time and a scalar fallback that every version must agree with. included by peer_protocol.h,
+// which defines the types used here.
+//
+// a (version, round) pair packs into a 16 bit key with the version in the high byte, so comparing
+// keys as unsigned integers is the same as comparing the pairs lexicographically. advert entries
+// on the wire are | element (16 bit) | version | round |, so two adverts that list the same
+// elements in the same order can be compared lane by lane without decoding them
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+typedef uint16_t causalKey_t;
+
+inline causalKey_t causalKey(causalNum_t version, causalNum_t round) {
+    return (causalKey_t)(((causalKey_t)version << 8) | round);
+}
+
+// walks two runs of n advert entries side by side. stops at the first position where the element
+// ids differ and returns it (n if they never do). every element before that where theirs is
+// ahead of ours is appended to ahead, in order
+inline size_t CompareAdvertEntriesScalar(const uint8_t *theirs, const uint8_t *ours, size_t n, std::vector<elementId_t> *ahead) {
+    for(size_t idx = 0; idx < n; idx++) {
+        const uint8_t *t = theirs + 4*idx;
+        const uint8_t *o = ours + 4*idx;
+        if(t[0] != o[0] || t[1] != o[1]) {
+            return idx;
+        }
+        if(causalKey(t[2], t[3]) > causalKey(o[2], o[3])) {
+            ahead->push_back(oneByteToTwo(t));
+        }
+    }
+    return n;
+}
+
+// index of the first largest key, or n if there are none
+inline size_t MaxKeyIndexScalar(const causalKey_t *keys, size_t n) {
+    size_t best = n;
+    for(size_t idx = 0; idx < n; idx++) {
+        if(best == n || keys[idx] > keys[best]) {
+            best = idx;
+        }
+    }
+    return best;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// the vector paths read each entry as two 16 bit lanes: the element id, then the key with its
+// bytes in wire order (version low). they swap the key bytes, and compare unsigned by flipping the
+// sign bit, since there is no unsigned 16 bit compare below AVX-512
+
+// handles one block of entries given the byte masks from movemask: eqMask has the two element
+// bytes of an entry set when the ids match, gtMask has the two key bytes set when theirs is ahead.
+// returns the index within the block of the first mismatch, or entries if there was none
+inline size_t CompareAdvertBlock(const uint8_t *theirs, uint32_t eqMask, uint32_t gtMask, size_t entries, std::vector<elementId_t> *ahead) {
+    for(size_t j = 0; j < entries; j++) {
+        if(((eqMask >> (4*j)) & 0x3) != 0x3) {
+            return j;
+        }
+        if((gtMask >> (4*j + 2)) & 0x1) {
+            ahead->push_back(oneByteToTwo(theirs + 4*j));
+        }
+    }
+    return entries;
+}
+#endif
+
+inline size_t CompareAdvertEntries(const uint8_t *theirs, const uint8_t *ours, size_t n, std::vector<elementId_t> *ahead) {
+    size_t idx = 0;
+#if defined(__AVX2__)
+    const __m256i bias = _mm256_set1_epi16((short)0x8000);
+    for(; idx + 8 <= n; idx += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(theirs + 4*idx));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(ours + 4*idx));
+        uint32_t eqMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b));
+        __m256i as = _mm256_or_si256(_mm256_slli_epi16(a, 8), _mm256_srli_epi16(a, 8));
+        __m256i bs = _mm256_or_si256(_mm256_slli_epi16(b, 8), _mm256_srli_epi16(b, 8));
+        uint32_t gtMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi16(_mm256_xor_si256(as, bias), _mm256_xor_si256(bs, bias)));
+        if((eqMask & 0x33333333u) == 0x33333333u && (gtMask & 0xCCCCCCCCu) == 0) {
+            continue;
+        }
+        size_t j = CompareAdvertBlock(theirs + 4*idx, eqMask, gtMask, 8, ahead);
+        if(j != 8) {
+            return idx + j;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    for(; idx + 4 <= n; idx += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(theirs + 4*idx));
+        __m128i b = _mm_loadu_si128((const __m128i*)(ours + 4*idx));
+        uint32_t eqMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(a, b));
+        __m128i as = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+        __m128i bs = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+        uint32_t gtMask = (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_xor_si128(as, bias), _mm_xor_si128(bs, bias)));
+        if((eqMask & 0x3333u) == 0x3333u && (gtMask & 0xCCCCu) == 0) {
+            continue;
+        }
+        size_t j = CompareAdvertBlock(theirs + 4*idx, eqMask, gtMask, 4, ahead);
+        if(j != 4) {
+            return idx + j;
+        }
+    }
+#endif
+    return idx + CompareAdvertEntriesScalar(theirs + 4*idx, ours + 4*idx, n - idx, ahead);
+}
+
+inline size_t MaxKeyIndex(const causalKey_t *keys, size_t n) {
+    if(n == 0) {
+        return n;
+    }
+    // find the largest key in bulk, then the first position holding it
+    causalKey_t best = 0;
+    size_t idx = 0;
+#if defined(__AVX2__)
+    if(n >= 16) {
+        const __m256i bias = _mm256_set1_epi16((short)0x8000);
+        __m256i m = _mm256_set1_epi16((short)0x8000);
+        for(; idx + 16 <= n; idx += 16) {
+            m = _mm256_max_epi16(m, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + idx)), bias));
+        }
+        __m128i h = _mm_max_epi16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+        h = _mm_max_epi16(h, _mm_srli_si128(h, 8));
+        h = _mm_max_epi16(h, _mm_srli_si128(h, 4));
+        h = _mm_max_epi16(h, _mm_srli_si128(h, 2));
+        best = (causalKey_t)(_mm_cvtsi128_si32(h) ^ 0x8000);
+    }
+#elif defined(__SSE2__)
+    if(n >= 8) {
+        const __m128i bias = _mm_set1_epi16((short)0x8000);
+        __m128i m = _mm_set1_epi16((short)0x8000);
+        for(; idx + 8 <= n; idx += 8) {
+            m = _mm_max_epi16(m, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + idx)), bias));
+        }
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 8));
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 4));
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 2));
+        best = (causalKey_t)(_mm_cvtsi128_si32(m) ^ 0x8000);
+    }
+#endif
+    for(; idx < n; idx++) {
+        if(keys[idx] > best) {
+            best = keys[idx];
+        }
+    }
+    for(idx = 0; keys[idx] != best; idx++) {
+    }
+    return idx;
+}
+
+#endif
@@ -0,0 +1,206 @@
+// counts heap allocations made while a peer handles each message type once its state has settled.
+// the steady-state receive path is meant to be allocation free, so any nonzero count is a regression.
+//
+// this does not need ns-3:
+//   g++ -std=c++17 -O2 -o alloc_count alloc_count.cpp && ./alloc_count
+// the exit status is nonzero if any message type allocated. it also checks that a SEND_DATA_CHUNK
+// claiming a huge transfer, from a stranger or from a neighbor, is dropped without allocating
+
+#include "peer_protocol.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static bool countAllocations = false;
+static size_t allocations = 0;
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    if(countAllocations) {
+        allocations++;
+    }
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+// a transport that parks outgoing messages in fixed slots so delivering them later does not allocate
+class LoopbackTransport : public PeerTransport {
+public:
+    struct Slot {
+        uint32_t address;
+        size_t size;
+        std::array<uint8_t, 1500> data;
+    };
+
+    void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+        if(queued == slots.size() || mesg.size() > Slot().data.size()) {
+            std::fprintf(stderr, "loopback queue overflow\n");
+            std::exit(2);
+        }
+        Slot &slot = slots[queued++];
+        slot.address = address;
+        slot.size = mesg.size();
+        std::copy(mesg.begin(), mesg.end(), slot.data.begin());
+    }
+
+    std::array<Slot, 64> slots;
+    size_t queued = 0;
+};
+
+static const uint32_t baseAddress = 0x0A010101;
+static const size_t numNodes = 3;
+
+static PeerProtocol peers[numNodes];
+static LoopbackTransport transports[numNodes];
+static int64_t now = 0;
+
+// hands every queued message to its destination until nothing is left in flight
+static void Drain() {
+    bool moved = true;
+    while(moved) {
+        moved = false;
+        for(size_t n = 0; n < numNodes; n++) {
+            LoopbackTransport &t = transports[n];
+            for(size_t idx = 0; idx < t.queued; idx++) {
+                const LoopbackTransport::Slot &slot = t.slots[idx];
+                peers[slot.address - baseAddress].ReceiveMessage(slot.data.data(), slot.size, now);
+            }
+            moved = moved || t.queued != 0;
+            t.queued = 0;
+        }
+    }
+}
+
+static void Beacon(size_t from) {
+    const std::vector<uint8_t> &mesg = peers[from].BuildAdvertisement(baseAddress + from);
+    for(size_t to = 0; to < numNodes; to++) {
+        if(to != from) {
+            peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+        }
+    }
+}
+
+// delivers one copy of the message to `to` iterations times and returns the allocations per delivery
+static double Measure(size_t to, const std::vector<uint8_t> &mesg, size_t iterations) {
+    // one uncounted delivery first: confirming a node in a sync epoch bucket that has not been
+    // used yet can grow that bucket once
+    peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+    transports[to].queued = 0;
+    allocations = 0;
+    countAllocations = true;
+    for(size_t i = 0; i < iterations; i++) {
+        transports[to].queued = 0;
+        peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+    }
+    countAllocations = false;
+    transports[to].queued = 0;
+    return double(allocations)/iterations;
+}
+
+// like Measure, but alternates between two messages, so a receiver that skips a message it has just
+// seen does the full work on every delivery
+static double MeasureAlternating(size_t to, const std::vector<uint8_t> &first, const std::vector<uint8_t> &second, size_t iterations) {
+    peers[to].ReceiveMessage(first.data(), first.size(), now);
+    peers[to].ReceiveMessage(second.data(), second.size(), now);
+    transports[to].queued = 0;
+    allocations = 0;
+    countAllocations = true;
+    for(size_t i = 0; i < iterations; i++) {
+        transports[to].queued = 0;
+        const std::vector<uint8_t> &mesg = i % 2 == 0 ? first : second;
+        peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+    }
+    countAllocations = false;
+    transports[to].queued = 0;
+    return double(allocations)/iterations;
+}
+
+int main() {
+    std::vector<std::pair<location_t, location_t>> baseElementLocations{
+        {2.5f, 5.5f},
+        {1.0f, 4.0f},
+        {3.0f, 6.5f},
+        {5.0f, 9.0f},
+        {6.0f, 2.5f}
+    };
+    auto catalog = std::make_shared<const ElementCatalog>(baseElementLocations, 8.0f);
+    for(size_t n = 0; n < numNodes; n++) {
+        peers[n].Setup(n, &transports[n], catalog);
+    }
+
+    // let the group form and converge the way it would in the simulation
+    for(int round = 0; round < 10; round++) {
+        now += 1000;
+        for(size_t n = 0; n < numNodes; n++) {
+            peers[n].UpdateNearbyElements(4.0f, 5.0f, now);
+            Beacon(n);
+            Drain();
+        }
+    }
+
+    const size_t iterations = 1000;
+    const elementId_t element = 0;
+    std::vector<uint8_t> mesg;
+
+    // the messages are captured before counting starts; building them is not part of the receive path
+    mesg = peers[1].BuildAdvertisement(baseAddress + 1);
+    double advert = Measure(0, mesg, iterations);
+
+    // an advert that repeats the last one from its sender is skipped after a memcmp. this one
+    // differs from it in one entry, put a round behind ours so that it asks for nothing, and has
+    // to be compared in full each time
+    std::vector<uint8_t> changed = mesg;
+    ADVERT_Message parsed;
+    if(!ADVERT_Message::deserialize(changed.data(), changed.size(), &parsed) || parsed.entries.size() == 0 || parsed.entries.round(0) == 0) {
+        std::fprintf(stderr, "the group did not settle\n");
+        return 2;
+    }
+    changed[parsed.entries.bytes() - changed.data() + 3]--;
+    double changedAdvert = MeasureAlternating(0, mesg, changed, iterations);
+
+    REQUEST_DATA_Message(1, element).serialize(&mesg);
+    double request = Measure(0, mesg, iterations);
+
+    SEND_DATA_Message::serialize(0, element, peers[0].get_AgreementInformation().at(element), peers[0].get_epoch(), &mesg);
+    double sendData = Measure(1, mesg, iterations);
+
+    ACK_Message(1, element).serialize(&mesg);
+    double ack = Measure(0, mesg, iterations);
+
+    std::printf("ADVERT: %.3f allocations per message\n", advert);
+    std::printf("changed ADVERT: %.3f allocations per message\n", changedAdvert);
+    std::printf("REQUEST_DATA: %.3f allocations per message\n", request);
+    std::printf("SEND_DATA: %.3f allocations per message\n", sendData);
+    std::printf("ACK: %.3f allocations per message\n", ack);
+
+    // the total in a SEND_DATA_CHUNK is only a claim: neither a node we have never heard from nor a
+    // neighbor whose chunks could not add up to it gets anything set aside for it. these are counted
+    // from the first delivery, since a regression would allocate gigabytes on that one
+    size_t bogus = 0;
+    for(nodeId_t sender : {nodeId_t(99), nodeId_t(1)}) {
+        mesg.clear();
+        mesg.push_back(SEND_DATA_CHUNK);
+        fourByteToOne(sender, &mesg);
+        twoByteToOne(element, &mesg);
+        fourByteToOne(1, &mesg);
+        fourByteToOne(UINT32_MAX, &mesg);
+        twoByteToOne(0, &mesg);
+        twoByteToOne(1, &mesg);
+        mesg.push_back(0);
+        allocations = 0;
+        countAllocations = true;
+        peers[0].ReceiveMessage(mesg.data(), mesg.size(), now);
+        countAllocations = false;
+        transports[0].queued = 0;
+        bogus += allocations;
+    }
+    std::printf("oversized SEND_DATA_CHUNK: %zu allocations\n", bogus);
+
+    return (advert + changedAdvert + request + sendData + ack) == 0 && bogus == 0 ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// timing helpers shared by the standalone benchmarks
+
+#include <chrono>
+#include <cstddef>
+
+// nanoseconds per call of f, over enough calls to take a few milliseconds
+template<typename F>
+static double TimeCalls(F f) {
+    size_t calls = 1;
+    while(true) {
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < calls; i++) {
+            f();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if(ns > 5e6) {
+            return ns / calls;
+        }
+        calls *= 2;
+    }
+}
+
+// keeps the compiler from dropping a result that is computed only to be timed
+template<typename T>
+static void KeepResult(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef NS3_STUB_H
+#define NS3_STUB_H
+
+// just enough of the ns-3 api, as declarations with empty bodies, for peer_node.cpp and
+// edge_node.cpp to be compiled where ns-3 is not installed. nothing here runs a simulation;
+// see syntax_check.sh. when one of the programs starts using more of ns-3, add it here
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <cstdint>
+#include <cmath>
+#include <memory>
+namespace ns3 {
+template<class T> class Ptr { public: T* p=nullptr; Ptr(){} Ptr(T*q):p(q){} template<class U> Ptr(const Ptr<U>&o):p(o.p){} T* operator->() const {return p;} T& operator*() const {return *p;} explicit operator bool() const {return p;} bool operator!() const {return !p;} T* PeekPointer() const {return p;}};
+template<class T, class... A> Ptr<T> Create(A&&... a){return Ptr<T>(new T(std::forward<A>(a)...));}
+template<class T, class... A> Ptr<T> CreateObject(A&&... a){return Ptr<T>(new T(std::forward<A>(a)...));}
+template<class T, class U> Ptr<T> DynamicCast(const Ptr<U>& u){return Ptr<T>(dynamic_cast<T*>(u.p));}
+struct AttributeValue { virtual ~AttributeValue(){} };
+struct DoubleValue : AttributeValue { DoubleValue(double=0){} double Get() const {return 0;} };
+struct UintegerValue : AttributeValue { UintegerValue(uint64_t=0){} uint64_t Get() const {return 0;} };
+struct BooleanValue : AttributeValue { BooleanValue(bool=false){} };
+struct StringValue : AttributeValue { StringValue(std::string=""){} std::string Get() const {return "";} };
+struct Time { Time(){} Time(std::string){} int64_t GetMilliSeconds() const {return 0;} int64_t GetMicroSeconds() const {return 0;} int64_t GetNanoSeconds() const {return 0;} double GetSeconds() const {return 0;} int64_t GetInteger() const {return 0;} bool IsZero() const {return true;} bool IsPositive() const {return true;}};
+inline Time operator-(Time,Time){return Time();} inline Time operator+(Time,Time){return Time();} inline bool operator>=(Time,Time){return true;} inline bool operator<(Time,Time){return true;} inline bool operator>(Time,Time){return true;} inline bool operator<=(Time,Time){return true;}
+inline Time operator*(Time,double){return Time();}
+inline std::ostream& operator<<(std::ostream&o,Time){return o;}
+struct TimeValue : AttributeValue { TimeValue(Time=Time()){} };
+inline Time Seconds(double){return Time();} inline Time MilliSeconds(int64_t){return Time();} inline Time MicroSeconds(int64_t){return Time();} inline Time NanoSeconds(int64_t){return Time();}
+struct Object { virtual ~Object(){} void SetAttribute(std::string, const AttributeValue&){} template<class T> Ptr<T> GetObject() const {return Ptr<T>();} void AggregateObject(Ptr<Object>){} virtual void DoDispose(){} void Dispose(){} };
+struct EventId { void Cancel(){} bool IsRunning() const {return false;} bool IsExpired() const {return true;} };
+struct Simulator { template<class... A> static EventId Schedule(Time, A&&...){return EventId();} template<class... A> static EventId ScheduleNow(A&&...){return EventId();} static Time Now(){return Time();} static void Run(){} static void Destroy(){} static void Stop(Time){} static void Stop(){} static void Cancel(EventId&){} static uint64_t GetEventCount(){return 0;} };
+struct Ipv4Address { Ipv4Address(){} Ipv4Address(uint32_t){} Ipv4Address(const char*){} uint32_t Get() const {return 0;} template<class M> Ipv4Address CombineMask(const M&) const {return {};} template<class M> Ipv4Address GetSubnetDirectedBroadcast(const M&) const {return {};} static Ipv4Address GetBroadcast(){return {};} static Ipv4Address GetAny(){return {};} bool operator<(const Ipv4Address&) const {return false;} bool operator==(const Ipv4Address&) const {return true;} };
+inline std::ostream& operator<<(std::ostream&o,Ipv4Address){return o;}
+struct Address { };
+struct InetSocketAddress { InetSocketAddress(Ipv4Address, uint16_t=0){} Ipv4Address GetIpv4() const {return {};} uint16_t GetPort() const {return 0;} static InetSocketAddress ConvertFrom(const Address&){return InetSocketAddress(Ipv4Address());} static bool IsMatchingType(const Address&){return true;} operator Address() const {return Address();} };
+struct Ipv4Mask { Ipv4Mask(){} Ipv4Mask(const char*){} };
+struct Packet { Packet(){} Packet(const uint8_t*, uint32_t){} Packet(uint32_t){} uint32_t GetSize() const {return 0;} uint32_t CopyData(uint8_t*, uint32_t) const {return 0;} };
+struct Node;
+template<class R, class... A> struct Callback { Callback(){} template<class F> Callback(F){} };
+template<class M, class O> std::function<void(Ptr<struct Socket>)> MakeCallback(M, O){return {};}
+struct TypeId { static TypeId LookupByName(std::string){return {};} };
+struct Socket : Object { static Ptr<Socket> CreateSocket(Ptr<Node>, TypeId){return {};} int Bind(Address){return 0;} int Bind(){return 0;} int Connect(Address){return 0;} void SetAllowBroadcast(bool){} template<class F> void SetRecvCallback(F){} int Send(Ptr<Packet>){return 0;} int SendTo(Ptr<Packet>, uint32_t, Address){return 0;} Ptr<Packet> Recv(){return {};} Ptr<Packet> RecvFrom(Address&){return {};} int GetPeerName(Address&) const {return 0;} int BindToNetDevice(Ptr<struct NetDevice>){return 0;} int Close(){return 0;} };
+struct UdpSocketFactory { static TypeId GetTypeId(){return {};} };
+struct Ipv4InterfaceAddress { Ipv4Address GetLocal() const {return {};} Ipv4Mask GetMask() const {return {};} };
+struct Ipv4 : Object { Ptr<struct NetDevice> GetNetDevice(uint32_t) const {return {};} uint16_t GetMtu(uint32_t) const {return 1500;} Ipv4InterfaceAddress GetAddress(uint32_t,uint32_t) const {return {};} int32_t GetInterfaceForDevice(Ptr<struct NetDevice>) const {return 0;} };
+struct Vector3D { double x=0,y=0,z=0; Vector3D(){} Vector3D(double a,double b,double c):x(a),y(b),z(c){} };
+typedef Vector3D Vector;
+struct MobilityModel : Object { Vector3D GetPosition() const {return {};} void SetPosition(Vector3D){} double GetDistanceFrom(Ptr<MobilityModel>) const {return 0;} };
+struct ConstantPositionMobilityModel : MobilityModel {};
+struct NetDevice : Object { uint32_t GetIfIndex() const {return 0;} Ptr<Node> GetNode() const; };
+struct Application;
+struct Node : Object { uint32_t GetId() const {return 0;} void AddApplication(Ptr<Application>){} Ptr<NetDevice> GetDevice(uint32_t) const {return {};} uint32_t GetNDevices() const {return 0;} };
+inline Ptr<Node> NetDevice::GetNode() const {return {};}
+struct Application : Object { Ptr<Node> GetNode() const {return {};} void SetStartTime(Time){} void SetStopTime(Time){} virtual void StartApplication(){} virtual void StopApplication(){} void SetNode(Ptr<Node>){} };
+struct NodeContainer { NodeContainer(){} NodeContainer(Ptr<Node>){} NodeContainer(const NodeContainer&, const NodeContainer&){} void Create(uint32_t){} Ptr<Node> Get(uint32_t) const {return {};} uint32_t GetN() const {return 0;} void Add(Ptr<Node>){} void Add(const NodeContainer&){} };
+struct NetDeviceContainer { Ptr<NetDevice> Get(uint32_t) const {return {};} uint32_t GetN() const {return 0;} void Add(const NetDeviceContainer&){} };
+struct ApplicationContainer { void Start(Time){} void Stop(Time){} };
+struct RandomVariableStream : Object { double GetValue(){return 0;} uint32_t GetInteger(){return 0;} void SetStream(int64_t){} int64_t GetStream() const {return 0;} };
+struct UniformRandomVariable : RandomVariableStream { double GetValue(){return 0;} double GetValue(double,double){return 0;} uint32_t GetInteger(uint32_t,uint32_t){return 0;} };
+struct ExponentialRandomVariable : RandomVariableStream { };
+struct ParetoRandomVariable : RandomVariableStream { };
+struct ConstantRandomVariable : RandomVariableStream { };
+struct WeibullRandomVariable : RandomVariableStream { };
+struct RngSeedManager { static void SetSeed(uint32_t){} static void SetRun(uint64_t){} static uint32_t GetSeed(){return 0;} static uint64_t GetRun(){return 0;} };
+struct PositionAllocator : Object { };
+struct RandomRectanglePositionAllocator : PositionAllocator { void SetX(Ptr<RandomVariableStream>){} void SetY(Ptr<RandomVariableStream>){} };
+struct ListPositionAllocator : PositionAllocator { void Add(Vector3D){} };
+struct MobilityHelper { void SetPositionAllocator(Ptr<PositionAllocator>){} template<class... A> void SetMobilityModel(std::string, A&&...){} void Install(NodeContainer){} void Install(Ptr<Node>){} };
+enum WifiStandard { WIFI_STANDARD_80211b, WIFI_STANDARD_80211a, WIFI_STANDARD_80211g };
+struct WifiPhyHelper { enum { DLT_IEEE802_11_RADIO, DLT_IEEE802_11 }; void Set(std::string, const AttributeValue&){} void SetPcapDataLinkType(int){} void EnablePcap(std::string, NetDeviceContainer){} void EnablePcap(std::string, Ptr<NetDevice>){} };
+struct YansWifiChannel : Object {};
+struct YansWifiPhyHelper : WifiPhyHelper { void SetChannel(Ptr<YansWifiChannel>){} };
+struct YansWifiChannelHelper { template<class... A> void SetPropagationDelay(std::string, A&&...){} template<class... A> void AddPropagationLoss(std::string, A&&...){} Ptr<YansWifiChannel> Create(){return {};} };
+struct WifiMacHelper { template<class... A> void SetType(std::string, A&&...){} };
+struct WifiHelper { void SetStandard(WifiStandard){} template<class... A> void SetRemoteStationManager(std::string, A&&...){} NetDeviceContainer Install(WifiPhyHelper&, WifiMacHelper&, NodeContainer){return {};} };
+struct Config { static void SetDefault(std::string, const AttributeValue&){} };
+struct InternetStackHelper { void Install(NodeContainer){} };
+struct Ipv4InterfaceContainer { Ipv4Address GetAddress(uint32_t, uint32_t=0) const {return {};} };
+struct Ipv4AddressHelper { void SetBase(const char*, const char*){} void SetBase(Ipv4Address, Ipv4Mask){} Ipv4InterfaceContainer Assign(NetDeviceContainer){return {};} void NewNetwork(){} };
+struct Ipv4GlobalRoutingHelper { static void PopulateRoutingTables(){} };
+struct CsmaHelper { void SetChannelAttribute(std::string, const AttributeValue&){} NetDeviceContainer Install(NodeContainer){return {};} };
+struct PointToPointHelper { void SetDeviceAttribute(std::string, const AttributeValue&){} void SetChannelAttribute(std::string, const AttributeValue&){} NetDeviceContainer Install(NodeContainer){return {};} };
+struct UdpEchoClientHelper { UdpEchoClientHelper(Ipv4Address, uint16_t){} void SetAttribute(std::string, const AttributeValue&){} ApplicationContainer Install(Ptr<Node>){return {};} };
+struct CommandLine { CommandLine(){} CommandLine(std::string){} template<class T> void AddValue(std::string, std::string, T&){} void Parse(int, char**){} };
+struct EnergySource : Object { double GetRemainingEnergy(){return 0;} };
+struct EnergySourceContainer { Ptr<EnergySource> Get(uint32_t) const {return {};} uint32_t GetN() const {return 0;} };
+struct DeviceEnergyModel : Object { double GetTotalEnergyConsumption() const {return 0;} };
+struct DeviceEnergyModelContainer { Ptr<DeviceEnergyModel> Get(uint32_t) const {return {};} uint32_t GetN() const {return 0;} };
+struct BasicEnergySourceHelper { void Set(std::string, const AttributeValue&){} EnergySourceContainer Install(NodeContainer) const {return {};} };
+struct WifiRadioEnergyModelHelper { void Set(std::string, const AttributeValue&){} DeviceEnergyModelContainer Install(NetDeviceContainer, EnergySourceContainer) const {return {};} };
+struct WifiPhy : Object { void SetSleepMode(){} void ResumeFromSleep(){} };
+struct WifiNetDevice : NetDevice { Ptr<WifiPhy> GetPhy() const {return {};} };
+enum LogLevel { LOG_LEVEL_INFO, LOG_LEVEL_ALL, LOG_INFO };
+inline void LogComponentEnable(const char*, LogLevel){}
+struct Ssid { Ssid(std::string){} };
+struct SsidValue : AttributeValue { SsidValue(Ssid){} };
+}
+#define NS_LOG_COMPONENT_DEFINE(x) static int g_log_dummy = 0
+#define NS_LOG_INFO(msg) do { std::ostringstream _oss; _oss << msg; (void)g_log_dummy; } while(0)
+#define NS_LOG_WARN(msg) NS_LOG_INFO(msg)
+#define NS_LOG_ERROR(msg) NS_LOG_INFO(msg)
+#define NS_LOG_UNCOND(msg) NS_LOG_INFO(msg)
+#define NS_ASSERT(x)
+#define NS_ASSERT_MSG(x,m)
+#define NS_FATAL_ERROR(msg) do { std::ostringstream _oss; _oss << msg; std::abort(); } while(0)
+
+#endif
@@ -0,0 +1 @@
+#include "../ns3-stub.h"
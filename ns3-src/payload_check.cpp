@@ -0,0 +1,111 @@
+// checks that repeated writes to one element's feature data replicate, and that a write past the
+// last version is refused rather than lost. three peers in range of each other share one element;
+// peer 0 edits it over and over, and after each edit the group runs until it agrees again.
+//
+// this does not need ns-3:
+//   g++ -std=c++17 -O2 -o payload_check payload_check.cpp && ./payload_check
+// the exit status is nonzero if any accepted write failed to reach every peer, or if a write
+// beyond the last version was accepted or disturbed what the peers hold
+
+#include "peer_protocol.h"
+
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <random>
+
+static const uint32_t baseAddress = 0x0A010101;
+static const size_t numNodes = 3;
+
+struct Delivery {
+    uint32_t to;
+    std::vector<uint8_t> mesg;
+};
+
+static std::deque<Delivery> inFlight;
+
+class QueueTransport : public PeerTransport {
+public:
+    void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+        inFlight.push_back(Delivery{address - baseAddress, mesg});
+    }
+};
+
+static PeerProtocol peers[numNodes];
+static QueueTransport transports[numNodes];
+static int64_t now = 0;
+
+// a few seconds of beacons, with everything they set off delivered straight away
+static void Run(int seconds) {
+    for(int s = 0; s < seconds; s++) {
+        now += 1000;
+        for(size_t n = 0; n < numNodes; n++) {
+            peers[n].UpdateNearbyElements(0.0f, 0.0f, now);
+            for(size_t part = 0, parts = peers[n].AdvertisementParts(); part < parts; part++) {
+                std::vector<uint8_t> mesg = peers[n].BuildAdvertisement(baseAddress + n, part);
+                for(size_t to = 0; to < numNodes; to++) {
+                    if(to != n) {
+                        peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+                    }
+                }
+            }
+            while(!inFlight.empty()) {
+                Delivery d = std::move(inFlight.front());
+                inFlight.pop_front();
+                peers[d.to].ReceiveMessage(d.mesg.data(), d.mesg.size(), now);
+            }
+            peers[n].CheckTransfers(now);
+        }
+    }
+}
+
+// how many peers hold exactly data as the element's payload
+static size_t Replicas(elementId_t element, const std::vector<uint8_t> &data) {
+    size_t count = 0;
+    std::vector<uint8_t> out;
+    for(const PeerProtocol &peer : peers) {
+        count += peer.GetPayload(element, &out) && out == data;
+    }
+    return count;
+}
+
+int main() {
+    std::vector<std::pair<location_t, location_t>> locations{{0.0f, 0.0f}};
+    auto catalog = std::make_shared<const ElementCatalog>(locations, 8.0f);
+    for(size_t n = 0; n < numNodes; n++) {
+        peers[n].Setup(n, &transports[n], catalog);
+        peers[n].locationNoiseRange = 0.0f;
+    }
+    Run(3);
+
+    const elementId_t element = 0;
+    const size_t writes = 300;
+    const size_t versions = std::numeric_limits<causalNum_t>::max();
+    std::mt19937 rng(525);
+    std::vector<uint8_t> data(4096), accepted;
+    size_t lost = 0, refused = 0, wrongAccept = 0;
+    for(size_t write = 1; write <= writes; write++) {
+        data[rng() % data.size()] = (uint8_t)rng();
+        bool ok = peers[0].SetPayload(element, data.data(), data.size(), now);
+        if(ok) {
+            accepted = data;
+            wrongAccept += write > versions;
+        }
+        else {
+            refused++;
+        }
+        Run(3);
+        // whatever was last accepted is what every peer must hold, refused writes or not
+        if(Replicas(element, accepted) != numNodes) {
+            lost++;
+            if(lost == 1) {
+                std::printf("write %zu: only %zu of %zu peers hold the last accepted data\n", write, Replicas(element, accepted), numNodes);
+            }
+        }
+    }
+
+    std::printf("writes: %zu, accepted: %zu, refused: %zu, writes whose result did not replicate: %zu\n",
+        writes, writes - refused, refused, lost);
+    bool pass = lost == 0 && wrongAccept == 0 && refused == writes - versions;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,525 @@
+// replays recorded protocol traffic into the agreement logic, without ns-3 or a wifi stack:
+//   g++ -std=c++17 -O2 -o pcap_replay pcap_replay.cpp && ./pcap_replay edge-aware-*.pcap
+//
+// takes pcap captures (radiotap or plain 802.11 as ns-3 writes them, ethernet, linux cooked or raw
+// ip), pulls the udp payloads on the protocol ports out of them, and hands each message to
+// PeerProtocol::ReceiveMessage in capture time order. the replay is open loop: what the replayed
+// nodes send is counted but not delivered, since the capture already holds what the real nodes
+// heard. timers run on capture time, and a node's nearby elements are taken from its own adverts,
+// since a capture has no positions.
+//
+// a capture named like ns-3 names them, <prefix>-<node>-<device>.pcap, is what that node heard and
+// sent; every capture of the same node is merged and replayed into that node alone. unicast it
+// overheard for other nodes is skipped. any other capture (or every capture, with --shared) is
+// taken as a recording of one shared medium: a node is replayed for every sender seen, broadcasts
+// reach every other node seen so far, and unicast reaches whichever node uses the destination
+// address. the same packet seen twice within a second, through a retry or in two captures, is
+// only replayed once.
+//
+// prints one csv row per replayed node, then a summary with the replay rate. options:
+//   --shared           treat every capture as the shared medium
+//   --ports=80,8080    udp ports that carry protocol messages
+//   --dump             also print every node's final element state
+
+#include "peer_protocol.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+
+// one udp datagram pulled out of a capture
+struct Datagram {
+    int64_t time;
+    uint32_t src, dst;
+    uint16_t ipId;
+    bool broadcast;
+    std::vector<uint8_t> payload;
+};
+
+// reads the protocol datagrams out of one pcap file, in file order
+class PcapReader {
+public:
+    explicit PcapReader(const std::string &path_): path(path_) {
+        file = std::fopen(path.c_str(), "rb");
+        uint8_t header[24];
+        if(file == nullptr || std::fread(header, 1, sizeof(header), file) != sizeof(header)) {
+            error = "cannot read a pcap header";
+            return;
+        }
+        uint32_t magic = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+        if(magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+            swapped = false;
+        }
+        else if(magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+            swapped = true;
+        }
+        else {
+            error = "not a pcap file";
+            return;
+        }
+        nanoseconds = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+        linkType = Word(header + 20);
+        if(linkType != 1 && linkType != 101 && linkType != 105 && linkType != 113 && linkType != 127 && linkType != 228) {
+            error = "unsupported link type " + std::to_string(linkType);
+        }
+    }
+
+    ~PcapReader() {
+        if(file != nullptr) {
+            std::fclose(file);
+        }
+    }
+
+    // the next protocol datagram, skipping anything else. false at the end of the file
+    bool Next(const std::set<uint16_t> &ports, Datagram *d) {
+        uint8_t record[16];
+        while(error.empty() && std::fread(record, 1, sizeof(record), file) == sizeof(record)) {
+            uint32_t seconds = Word(record), fraction = Word(record + 4), length = Word(record + 8);
+            frame.resize(length);
+            if(std::fread(frame.data(), 1, length, file) != length) {
+                break;
+            }
+            frames++;
+            d->time = (int64_t)seconds * 1000 + fraction / (nanoseconds ? 1000000 : 1000);
+            if(Decode(frame.data(), frame.size(), ports, d)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string path, error;
+    uint64_t frames = 0;
+
+private:
+    uint32_t Word(const uint8_t *b) const {
+        return swapped ? (uint32_t)b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3] : b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+    }
+
+    // peels the link layer off, down to an ipv4 packet
+    bool Decode(const uint8_t *b, size_t len, const std::set<uint16_t> &ports, Datagram *d) const {
+        bool linkBroadcast = false;
+        if(linkType == 127) {
+            if(len < 4) {
+                return false;
+            }
+            size_t radiotap = b[2] | b[3] << 8;
+            if(len < radiotap) {
+                return false;
+            }
+            b += radiotap;
+            len -= radiotap;
+        }
+        if(linkType == 127 || linkType == 105) {
+            // data frames only, with a body and not encrypted
+            if(len < 24) {
+                return false;
+            }
+            uint16_t fc = b[0] | b[1] << 8;
+            uint8_t type = (fc >> 2) & 0x3, subtype = (fc >> 4) & 0xF;
+            if(type != 2 || (subtype & 0x4) || (fc & 0x4000)) {
+                return false;
+            }
+            size_t header = 24;
+            if((fc & 0x0300) == 0x0300) {
+                header += 6;
+            }
+            if(subtype & 0x8) {
+                header += (fc & 0x8000) ? 6 : 2;
+            }
+            linkBroadcast = b[4] & 0x1;
+            // llc/snap carrying ipv4
+            static const uint8_t snap[8] = {0xAA, 0xAA, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00};
+            if(len < header + 8 || std::memcmp(b + header, snap, 8) != 0) {
+                return false;
+            }
+            b += header + 8;
+            len -= header + 8;
+        }
+        else if(linkType == 1) {
+            if(len < 14) {
+                return false;
+            }
+            size_t header = 14;
+            uint16_t etherType = b[12] << 8 | b[13];
+            if(etherType == 0x8100 && len >= 18) {
+                etherType = b[16] << 8 | b[17];
+                header = 18;
+            }
+            if(etherType != 0x0800) {
+                return false;
+            }
+            linkBroadcast = b[0] & 0x1;
+            b += header;
+            len -= header;
+        }
+        else if(linkType == 113) {
+            if(len < 16 || (b[14] << 8 | b[15]) != 0x0800) {
+                return false;
+            }
+            linkBroadcast = (b[0] << 8 | b[1]) == 1;
+            b += 16;
+            len -= 16;
+        }
+
+        // unfragmented ipv4 carrying udp to one of the protocol ports
+        if(len < 20 || (b[0] >> 4) != 4 || b[9] != 17 || ((b[6] << 8 | b[7]) & 0x3FFF) != 0) {
+            return false;
+        }
+        size_t ipHeader = (b[0] & 0xF) * 4;
+        size_t total = b[2] << 8 | b[3];
+        if(total > len || total < ipHeader + 8) {
+            return false;
+        }
+        const uint8_t *udp = b + ipHeader;
+        size_t udpLength = udp[4] << 8 | udp[5];
+        if(udpLength < 8 || ipHeader + udpLength > total || ports.count(udp[2] << 8 | udp[3]) == 0) {
+            return false;
+        }
+        d->ipId = b[4] << 8 | b[5];
+        d->src = oneByteToFour(b + 12);
+        d->dst = oneByteToFour(b + 16);
+        d->broadcast = linkBroadcast || d->dst == 0xFFFFFFFF || (d->dst & 0xFFFF) == 0xFFFF;
+        d->payload.assign(udp + 8, udp + udpLength);
+        return true;
+    }
+
+    std::FILE *file = nullptr;
+    bool swapped = false, nanoseconds = false;
+    uint32_t linkType = 0;
+    std::vector<uint8_t> frame;
+};
+
+// counts what a replayed node sends instead of sending it
+class CountingTransport : public PeerTransport {
+public:
+    void SendTo(uint32_t, const std::vector<uint8_t> &) {
+        sent++;
+    }
+    uint64_t sent = 0;
+};
+
+struct ReplayNode {
+    PeerProtocol protocol;
+    CountingTransport transport;
+    // the addresses this node sends from or advertises
+    std::set<uint32_t> addresses;
+    uint64_t heard = 0, recordedSent = 0;
+    int64_t nextHeartbeat = 0, nextTransfers = 0;
+    // the elements of an advert that is coming in parts
+    std::vector<elementId_t> advertParts;
+};
+
+class Replay {
+public:
+    explicit Replay(std::shared_ptr<const ElementCatalog> catalog_): catalog(catalog_) {}
+
+    ReplayNode& Node(nodeId_t id, int64_t now) {
+        auto it = nodes.find(id);
+        if(it == nodes.end()) {
+            it = nodes.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple()).first;
+            it->second.protocol.Setup(id, &it->second.transport, catalog);
+            it->second.nextHeartbeat = now + 3000;
+            it->second.nextTransfers = now;
+        }
+        return it->second;
+    }
+
+    // runs the node's periodic checks that fall due up to now
+    void RunTimers(ReplayNode &node, int64_t now) {
+        while(node.nextTransfers <= now) {
+            node.protocol.CheckTransfers(node.nextTransfers);
+            node.nextTransfers += node.protocol.chunkRetryTimeout;
+        }
+        while(node.nextHeartbeat <= now) {
+            node.protocol.CheckHeartbeats(node.nextHeartbeat);
+            node.nextHeartbeat += 3000;
+        }
+    }
+
+    // a message this node sent. its adverts say which elements it was near
+    void Sent(ReplayNode &node, const Datagram &d) {
+        const uint8_t *buf = d.payload.data();
+        size_t len = d.payload.size();
+        node.addresses.insert(d.src);
+        ADVERT_Message advert;
+        ADVERT_PART_Message part;
+        if(buf[0] == ADVERT && ADVERT_Message::deserialize(buf, len, &advert)) {
+            node.addresses.insert(advert.ipv4Address);
+            nearby.clear();
+            for(size_t idx = 0; idx < advert.entries.size(); idx++) {
+                nearby.push_back(advert.entries.element(idx));
+            }
+            node.protocol.SetNearbyElements(nearby, d.time);
+        }
+        else if(buf[0] == ADVERT_PART && ADVERT_PART_Message::deserialize(buf, len, &part)) {
+            node.addresses.insert(part.ipv4Address);
+            if(part.part == 0) {
+                node.advertParts.clear();
+            }
+            for(size_t idx = 0; idx < part.entries.size(); idx++) {
+                node.advertParts.push_back(part.entries.element(idx));
+            }
+            if(part.part + 1 == part.parts) {
+                node.protocol.SetNearbyElements(node.advertParts, d.time);
+            }
+        }
+        else {
+            node.recordedSent++;
+        }
+    }
+
+    void Deliver(ReplayNode &node, const Datagram &d) {
+        node.heard++;
+        node.protocol.ReceiveMessage(d.payload.data(), d.payload.size(), d.time);
+    }
+
+    // false if the same packet was already replayed in the last second
+    bool FirstSighting(const Datagram &d) {
+        while(!recent.empty() && recent.front().first < d.time - 1000) {
+            seen.erase(recent.front().second);
+            recent.pop_front();
+        }
+        std::pair<uint64_t, uint64_t> key((uint64_t)d.src << 16 | d.ipId, digestBytes(d.payload.data(), d.payload.size()));
+        if(!seen.insert(key).second) {
+            return false;
+        }
+        recent.emplace_back(d.time, key);
+        return true;
+    }
+
+    // captures of different owners hold the same packets, and each owner needs its copy
+    void ForgetSightings() {
+        seen.clear();
+        recent.clear();
+    }
+
+    std::map<nodeId_t, ReplayNode> nodes;
+
+private:
+    std::shared_ptr<const ElementCatalog> catalog;
+    std::vector<elementId_t> nearby;
+    std::set<std::pair<uint64_t, uint64_t>> seen;
+    std::deque<std::pair<int64_t, std::pair<uint64_t, uint64_t>>> recent;
+};
+
+// merges captures by time
+class Merger {
+public:
+    Merger(const std::vector<std::unique_ptr<PcapReader>> &readers_, const std::set<uint16_t> &ports_): ports(ports_), pending(readers_.size()) {
+        for(size_t i = 0; i < readers_.size(); i++) {
+            readers.push_back(readers_[i].get());
+            Pull(i);
+        }
+    }
+
+    bool Next(Datagram *d) {
+        if(heads.empty()) {
+            return false;
+        }
+        size_t i = heads.top().second;
+        heads.pop();
+        std::swap(*d, pending[i]);
+        Pull(i);
+        return true;
+    }
+
+private:
+    void Pull(size_t i) {
+        if(readers[i]->Next(ports, &pending[i])) {
+            heads.emplace(pending[i].time, i);
+        }
+    }
+
+    // owned by the caller, which keeps them open for as long as the merger is used
+    std::vector<PcapReader*> readers;
+    std::set<uint16_t> ports;
+    std::vector<Datagram> pending;
+    std::priority_queue<std::pair<int64_t, size_t>, std::vector<std::pair<int64_t, size_t>>, std::greater<std::pair<int64_t, size_t>>> heads;
+};
+
+static bool IsMessage(const Datagram &d) {
+    // every message starts with its type and the sender's node id
+    return d.payload.size() >= 5 && d.payload[0] <= SYNC_ACK;
+}
+
+int main(int argc, char *argv[]) {
+    bool shared = false, dump = false;
+    std::set<uint16_t> ports{80, 8080};
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "--shared") {
+            shared = true;
+        }
+        else if(arg == "--dump") {
+            dump = true;
+        }
+        else if(arg.compare(0, 8, "--ports=") == 0) {
+            ports.clear();
+            size_t pos = 8;
+            while(pos < arg.size()) {
+                size_t comma = arg.find(',', pos);
+                ports.insert((uint16_t)std::stoul(arg.substr(pos, comma - pos)));
+                pos = comma == std::string::npos ? arg.size() : comma + 1;
+            }
+        }
+        else if(arg.compare(0, 2, "--") == 0) {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return 2;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+    if(paths.empty()) {
+        std::fprintf(stderr, "usage: %s [--shared] [--ports=80,8080] [--dump] capture.pcap...\n", argv[0]);
+        return 2;
+    }
+
+    // element ids are 16 bits; locations do not matter since nearby sets come from the adverts
+    std::vector<std::pair<location_t, location_t>> locations(UINT16_MAX + 1, std::make_pair(0.0f, 0.0f));
+    Replay replay(std::make_shared<const ElementCatalog>(locations, 8.0f));
+
+    // captures owned by a node, by node, and the ones of the shared medium
+    std::map<nodeId_t, std::vector<std::string>> owned;
+    std::vector<std::string> medium;
+    const std::regex ns3Name(".*-([0-9]+)-[0-9]+\\.pcap$");
+    for(const std::string &path : paths) {
+        std::smatch match;
+        if(!shared && std::regex_match(path, match, ns3Name)) {
+            owned[(nodeId_t)std::stoul(match[1])].push_back(path);
+        }
+        else {
+            medium.push_back(path);
+        }
+    }
+
+    uint64_t frames = 0, messages = 0, duplicates = 0, bytes = 0;
+    uint64_t byType[SYNC_ACK + 1] = {};
+    auto begin = std::chrono::steady_clock::now();
+    auto open = [&](const std::vector<std::string> &group, std::vector<std::unique_ptr<PcapReader>> *readers) {
+        for(const std::string &path : group) {
+            std::unique_ptr<PcapReader> reader(new PcapReader(path));
+            if(!reader->error.empty()) {
+                std::fprintf(stderr, "%s: %s\n", path.c_str(), reader->error.c_str());
+                std::exit(2);
+            }
+            readers->push_back(std::move(reader));
+        }
+    };
+    auto close = [&](std::vector<std::unique_ptr<PcapReader>> *readers) {
+        for(const std::unique_ptr<PcapReader> &reader : *readers) {
+            frames += reader->frames;
+        }
+        readers->clear();
+    };
+
+    Datagram d;
+    for(const auto &group : owned) {
+        std::vector<std::unique_ptr<PcapReader>> readers;
+        open(group.second, &readers);
+        Merger merger(readers, ports);
+        replay.ForgetSightings();
+        ReplayNode *owner = nullptr;
+        while(merger.Next(&d)) {
+            if(!IsMessage(d) || !replay.FirstSighting(d)) {
+                duplicates += IsMessage(d);
+                continue;
+            }
+            messages++;
+            byType[d.payload[0]]++;
+            bytes += d.payload.size();
+            if(owner == nullptr) {
+                owner = &replay.Node(group.first, d.time);
+            }
+            replay.RunTimers(*owner, d.time);
+            if(oneByteToFour(d.payload.data() + 1) == group.first) {
+                replay.Sent(*owner, d);
+            }
+            else if(d.broadcast || owner->addresses.count(d.dst)) {
+                replay.Deliver(*owner, d);
+            }
+        }
+        close(&readers);
+    }
+
+    if(!medium.empty()) {
+        std::vector<std::unique_ptr<PcapReader>> readers;
+        open(medium, &readers);
+        Merger merger(readers, ports);
+        std::map<uint32_t, nodeId_t> byAddress;
+        while(merger.Next(&d)) {
+            if(!IsMessage(d) || !replay.FirstSighting(d)) {
+                duplicates += IsMessage(d);
+                continue;
+            }
+            messages++;
+            byType[d.payload[0]]++;
+            bytes += d.payload.size();
+            nodeId_t sender = oneByteToFour(d.payload.data() + 1);
+            ReplayNode &from = replay.Node(sender, d.time);
+            replay.Sent(from, d);
+            for(uint32_t address : from.addresses) {
+                byAddress[address] = sender;
+            }
+            if(d.broadcast) {
+                for(auto &node : replay.nodes) {
+                    if(node.first != sender) {
+                        replay.RunTimers(node.second, d.time);
+                        replay.Deliver(node.second, d);
+                    }
+                }
+            }
+            else {
+                auto to = byAddress.find(d.dst);
+                if(to != byAddress.end() && to->second != sender) {
+                    ReplayNode &node = replay.nodes.at(to->second);
+                    replay.RunTimers(node, d.time);
+                    replay.Deliver(node, d);
+                }
+            }
+        }
+        close(&readers);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::printf("node,heard,recorded_sent,replayed_sent,nearby,elements\n");
+    std::vector<const PeerProtocol*> peers;
+    for(const auto &node : replay.nodes) {
+        const PeerProtocol &p = node.second.protocol;
+        std::printf("%u,%llu,%llu,%llu,%zu,%zu\n", node.first, (unsigned long long)node.second.heard,
+            (unsigned long long)node.second.recordedSent, (unsigned long long)node.second.transport.sent,
+            p.get_nearbyElements().size(), p.get_AgreementInformation().size());
+        peers.push_back(&p);
+    }
+    std::printf("# %zu captures, %llu frames, %llu messages (%llu duplicates skipped), %zu nodes, %zu converged elements\n",
+        paths.size(), (unsigned long long)frames, (unsigned long long)messages, (unsigned long long)duplicates,
+        replay.nodes.size(), CountConvergedElements(peers));
+    static const char *typeNames[SYNC_ACK + 1] = {"advert", "request_data", "send_data", "ack", "advert_part", "send_data_chunk", "chunk_ack", "request_chunks", "send_chunk", "sync_digest", "sync_data", "sync_ack"};
+    std::printf("#");
+    for(int type = 0; type <= SYNC_ACK; type++) {
+        std::printf(" %s=%llu", typeNames[type], (unsigned long long)byType[type]);
+    }
+    std::printf("\n");
+    std::printf("# replayed in %.3f s: %.0f messages/s, %.1f MB/s of payload\n", seconds, messages / seconds, bytes / seconds / 1e6);
+
+    if(dump) {
+        for(const auto &node : replay.nodes) {
+            std::printf("Ending state for node %u:\n", node.first);
+            for(const auto &elem : node.second.protocol.get_AgreementInformation()) {
+                std::ostringstream out;
+                out << "Element: " << unsigned(elem.first) << "\n" << elem.second;
+                std::printf("%s\n", out.str().c_str());
+            }
+        }
+    }
+    return 0;
+}
@@ -3,750 +3,978 @@
 #include "ns3/internet-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/point-to-point-module.h"
+#include "ns3/csma-module.h"
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/udp-echo-helper.h"
 #include "ns3/mobility-module.h"
 #include "ns3/mobility-helper.h"
 #include "ns3/ssid.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-module.h"
+#include "ns3/energy-module.h"
 
+#include <chrono>
+#include <fstream>
 #include <iomanip>
+#include <iterator>
+#include <limits>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("Peers");
 
-typedef enum : uint8_t {
-    ADVERT,
-    REQUEST_DATA,
-    SEND_DATA,
-    ACK,
+#define PEER_LOG(msg) NS_LOG_INFO(msg)
+#include "peer_protocol.h"
 
-} MessageType;
+// every node has two radios, as in src/README.txt: a short-range, low-rate, low-power one that only
+// carries beacons (standing in for bluetooth low energy), and a long-range one for the agreement
+// itself (standing in for cell). the beacon radio is ipv4 interface 1 and the data radio is
+// interface 2; 0 is loopback. edge servers also have a wired backhaul to each other on interface 3
+const uint32_t BeaconInterface = 1;
+const uint32_t DataInterface = 2;
+const uint32_t BackhaulInterface = 3;
 
-// elementId_t and causalNum_t should be the same
-typedef uint8_t elementId_t;
-typedef uint8_t causalNum_t;
-typedef uint32_t nodeId_t;
-typedef float location_t;
+// the beacon radios, the data radios and the backhaul are each numbered from their own /16, which
+// holds every node of a 10,000 node run with room to spare
+const char *SubnetMask = "255.255.0.0";
+const char *BeaconSubnet = "10.1.0.0";
+const char *DataSubnet = "10.2.0.0";
+const char *BackhaulSubnet = "10.3.0.0";
+const uint32_t MaxHostsPerSubnet = 65534;
 
+InetSocketAddress BeaconBroadcastAddress = InetSocketAddress(Ipv4Address(BeaconSubnet).GetSubnetDirectedBroadcast(Ipv4Mask(SubnetMask)), 80);
 
-InetSocketAddress BeaconBroadcastAddress = InetSocketAddress(Ipv4Address::GetBroadcast(), 80);
+class EdgeAwareClientApplication : public ns3::Application, public PeerTransport {
+public:
+    EdgeAwareClientApplication() {}
 
-// EVAN Addition >>>
-class AgreementInformation {
-public: 
-    AgreementInformation(std::pair<location_t, location_t>* cl, nodeId_t id): versionNumber(0), roundNumber(0) {
-        fineLocation = *cl;
-        agreeingNodes.insert(id);
+    void Setup(Ptr<Socket> dataSendSocket_, 
+                Ptr<Socket> dataRecvSocket_, 
+                Ptr<Socket> broadcastSendSocket_,
+                Ptr<Socket> broadcastRecvSocket_,
+                std::shared_ptr<const ElementCatalog> catalog_,
+                uint32_t pushFanout_,
+                uint32_t dataPeriod_,
+                uint32_t dataWindow_) 
+    {
+        catalog = catalog_;
+        pushFanout = pushFanout_;
+        dataPeriod = dataPeriod_;
+        dataWindow = dataWindow_;
+        dataSendSocket = dataSendSocket_;
+        dataRecvSocket = dataRecvSocket_;
+        broadcastSendSocket = broadcastSendSocket_;
+        broadcastRecvSocket = broadcastRecvSocket_;
+        broadcastRecvSocket->SetRecvCallback(MakeCallback(&EdgeAwareClientApplication::ReceiveData, this));    
+        dataRecvSocket->SetRecvCallback(MakeCallback(&EdgeAwareClientApplication::ReceiveData, this));
     }
 
-    void set_version(causalNum_t v) { versionNumber = v; }
-    causalNum_t get_version() { return versionNumber; }
-
-    void set_round(causalNum_t r) { roundNumber = r; }
-    causalNum_t get_round() { return roundNumber; }
+    // All the setup for the ports and sockets done here
+    void StartApplication() {
+        Ptr<Node> node = GetNode();
+        node_id = node->GetId();
 
-    void set_fineLocation(std::pair<location_t, location_t> *fl) {
-        fineLocation.first = fl->first;
-        fineLocation.second = fl->second;
-    }
-    std::pair<location_t, location_t> get_fineLocation() { return fineLocation; } 
+        // the element table is shared; each node perturbs an element's location when it first encounters it
+        protocol.Setup(node_id, this, catalog);
+        auto unif_rv = CreateObject<UniformRandomVariable>(); 
+        unif_rv->SetAttribute("Min", DoubleValue(-protocol.locationNoiseRange));
+        unif_rv->SetAttribute("Max", DoubleValue(protocol.locationNoiseRange));
+        protocol.locationNoise = [unif_rv]() { return (location_t)unif_rv->GetValue(); };
+        protocol.pushFanout = pushFanout;
+        auto push_rv = CreateObject<UniformRandomVariable>();
+        protocol.pushRandom = [push_rv]() { return push_rv->GetValue(); };
+        // keep every message inside one datagram on the data radio, less the IP and UDP headers
+        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+        protocol.maxMessageSize = ipv4->GetMtu(DataInterface) - 28;
+
+        // with batching, the data radio sleeps until the next window; a chunk retry any sooner
+        // than that would only queue a duplicate behind the first copy
+        dataPhy = DynamicCast<WifiNetDevice>(ipv4->GetNetDevice(DataInterface))->GetPhy();
+        beaconPhy = DynamicCast<WifiNetDevice>(ipv4->GetNetDevice(BeaconInterface))->GetPhy();
+        dataAwake = true;
+        if(dataPeriod > 0) {
+            protocol.chunkRetryTimeout = std::max(protocol.chunkRetryTimeout, dataPeriod);
+        }
+ 
+        if(!warmState.empty() && !protocol.LoadState(warmState.data(), warmState.size(), Simulator::Now().GetMilliSeconds())) {
+            NS_LOG_WARN("node " << node_id << " could not load its warm start state, starting cold");
+        }
 
+        NS_LOG_INFO("Starting node " << node_id << " with " << catalog->size() << " elements in the catalog");
 
-    bool add_agreeingNodes(nodeId_t n) { return agreeingNodes.insert(n).second; }
-    void set_agreeingNodes(std::set<nodeId_t> *ag) { 
-        agreeingNodes.clear();
-        agreeingNodes.insert(ag->begin(), ag->end());
+        if(payloadBytes > 0) {
+            payloadRandom = CreateObject<UniformRandomVariable>();
+        }
+        StartTimers(Seconds(1));
+        if(sessionTime) {
+            churnEvent = Simulator::Schedule(Seconds(sessionTime->GetValue()), &EdgeAwareClientApplication::GoOffline, this);
+        }
     }
-    bool count_agreeingNodes(nodeId_t n) { return agreeingNodes.count(n) == 1; }
-    std::set<nodeId_t> get_agreeingNodes() { return agreeingNodes; }
-    void clear_agreeingNodes() { agreeingNodes.clear(); }
 
-    friend std::ostream& operator<< (std::ostream &os, AgreementInformation &a) {
-        os << "Version: " << unsigned(a.versionNumber) << "\nRound: " << unsigned(a.roundNumber)  << std::endl;
-        os << "Location: (" << a.fineLocation.first << ", " << a.fineLocation.second << ")\n";
-        os << "Synchronized Nodes: ";
-        for(nodeId_t elem : a.agreeingNodes) {
-            os << elem << " ";
+    void StopApplication() {
+        // nothing scheduled may fire on a stopped application, the churn timer included
+        StopTimers();
+        Simulator::Cancel(churnEvent);
+        NS_LOG_INFO("Ending state for node " << node_id << ": ");
+        for(const auto &elem : protocol.get_AgreementInformation()) {
+            NS_LOG_INFO("Element: " << unsigned(elem.first) << "\n" << elem.second);
         }
+        const ChunkStore &store = protocol.get_chunkStore();
+        NS_LOG_INFO("Payload chunks held: " << store.held() << " (" << store.bytes() << " bytes), missing: " << store.get_missing().size());
+        NS_LOG_INFO("");
+    }
 
-        return os;
+    // PeerTransport: every unicast protocol message goes out on the data radio, straight away if
+    // it is awake and with the next batch otherwise
+    void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+        if(!online) {
+            return;
+        }
+        if(awaitingRecovery) {
+            recoveryBytes += mesg.size();
+        }
+        Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
+        if(!dataAwake) {
+            dataQueue.emplace_back(address, packet);
+            return;
+        }
+        dataSendSocket->SendTo(packet, 0, InetSocketAddress(Ipv4Address(address), 8080));
     }
-private:
-    causalNum_t versionNumber, roundNumber;
-    // no coarse location, as our system uses the same data type for both fine and coarse locations
-    std::pair<location_t, location_t> fineLocation;
-    std::set<nodeId_t> agreeingNodes;
-};
 
-class nodeEntry {
-public:
-    Ipv4Address address;
-    int64_t recentTime;
-    std::vector<std::pair<causalNum_t, causalNum_t>> versionRoundNumbers;
+    // state saved by PeerProtocol::SaveState to start from instead of an empty one
+    void WarmStart(std::vector<uint8_t> state) { warmState = std::move(state); }
+
+    // makes this node write bytes of data to every element it is near, see WritePayloads
+    void SetPayloadBytes(uint32_t bytes) { payloadBytes = bytes; }
 
-    nodeEntry(Ipv4Address ad, int64_t time): address(ad), recentTime(time), versionRoundNumbers(5, std::pair<causalNum_t, causalNum_t>{0, 0}) {
+    // turns on the churn model, see GoOffline. session and downtime lengths are drawn in seconds
+    void SetChurn(Ptr<RandomVariableStream> sessionTime_, Ptr<RandomVariableStream> downtime_, bool coldRejoin_) {
+        sessionTime = sessionTime_;
+        downtime = downtime_;
+        coldRejoin = coldRejoin_;
     }
 
-    friend std::ostream& operator<< (std::ostream &os, nodeEntry &n) {
-        os << "Address: " << n.address << "\nHeartbeat Time: " << n.recentTime  << std::endl;
-        for(size_t idx = 0; idx < n.versionRoundNumbers.size(); idx++) {
-            os << "Element: " << unsigned(idx) << " Version: " << unsigned(n.versionRoundNumbers.at(idx).first) << " Round: " << unsigned(n.versionRoundNumbers.at(idx).first) << std::endl;
-        }
-        return os;
-    } 
-private:
-};
+    // every rejoin that caught up, as (milliseconds to catch up, bytes sent and received meanwhile),
+    // and how many rejoins went down again before they caught up
+    const std::vector<std::pair<int64_t, uint64_t>>& get_recoveries() const { return recoveries; }
+    uint32_t get_unrecovered() const { return unrecovered; }
 
-// undoing transformation, so endianness should not matter
-std::vector<uint8_t> fourByteToOne(uint32_t c) {
-    std::vector<uint8_t> r(4);
-    r.at(3) = (c >> 24) & 0xFF;
-    r.at(2) = (c >> 16) & 0xFF;
-    r.at(1) = (c >> 8) & 0xFF;
-    r.at(0) = (c) & 0xFF;
-    return r;
-}
+    // the edges and what each owns, so pulls go to the owning edge; see PeerProtocol::edgePartition
+    void SetEdgePartition(std::shared_ptr<const EdgePartition> partition) { protocol.edgePartition = partition; }
 
-uint32_t oneByteToFour(std::vector<uint8_t> *c) {
-    uint32_t r = 0;
-    r += (uint32_t)(c->at(0));
-    r += (uint32_t)(c->at(1)) << 8;
-    r += (uint32_t)(c->at(2)) << 16;
-    r += (uint32_t)(c->at(3)) << 24;
-    return r;
-}
+    const PeerProtocol& get_protocol() const { return protocol; }
+    uint32_t get_dataWakeups() const { return dataWakeups; }
 
-/* FORMAT
- * | type   | nodeid |
- * |element |version | round  | ...
- *
- * | 8 bit  | 32 bit |
- * | 8 bit  | 8 bit  |  8 bit | ...
- *
- */
-class ADVERT_Message {
-public:
-    nodeId_t senderId;
-    uint32_t ipv4Address;
-    std::vector<elementId_t> elements;
-    std::vector<causalNum_t> versions;
-    std::vector<causalNum_t> rounds;
-
-    ADVERT_Message(nodeId_t id, uint32_t ad, std::set<elementId_t> *nearbyElements, std::vector<AgreementInformation> *elementInfo): 
-        senderId(id), ipv4Address(ad) 
-    { 
-        // initialize the lists of information that are propagated with the advertisement
-        elements.reserve(nearbyElements->size());
-        versions.reserve(nearbyElements->size());
-        rounds.reserve(nearbyElements->size());
-        for(elementId_t element : *nearbyElements) {
-            elements.push_back(element);
-            versions.push_back(elementInfo->at(element).get_version());
-            rounds.push_back(elementInfo->at(element).get_round());
-        }     
-    }
-
-    // alternative constructor for deserialization
-    ADVERT_Message(nodeId_t id, uint32_t ad, std::vector<elementId_t> *elems, std::vector<causalNum_t> *vers, std::vector<causalNum_t> *rnds): 
-        senderId(id), ipv4Address(ad) 
-    {
-        elements = *elems;
-        versions = *vers;
-        rounds = *rnds;
-    }
-    std::vector<uint8_t> serialize() {
-        std::vector<uint8_t> mesg{ADVERT};
-        std::vector<uint8_t> id_array = fourByteToOne(this->senderId);
-        mesg.insert(mesg.end(), id_array.begin(), id_array.end());
-        std::vector<uint8_t> ip_array = fourByteToOne(this->ipv4Address);
-        mesg.insert(mesg.end(), ip_array.begin(), ip_array.end());
-        
-        for(size_t idx = 0; idx < elements.size(); idx++) {
-            mesg.push_back(this->elements.at(idx));
-            mesg.push_back(this->versions.at(idx));
-            mesg.push_back(this->rounds.at(idx));
+private:
+    // the periodic work of a node that is up, with the first beacon and position check after first
+    void StartTimers(Time first) {
+        if(dataPeriod > 0) {
+            dataPhy->SetSleepMode();
+            dataAwake = false;
+            int64_t now = Simulator::Now().GetMilliSeconds();
+            dataRadioEvent = Simulator::Schedule(MilliSeconds((now / dataPeriod + 1) * dataPeriod - now), &EdgeAwareClientApplication::WakeDataRadio, this);
         }
+        sendEvent = Simulator::Schedule(first, &EdgeAwareClientApplication::SendAdvertisement, this);
+        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeAwareClientApplication::CheckHeartbeats, this);
+        checkNearbyElements = Simulator::Schedule(first, &EdgeAwareClientApplication::GetNearbyElements, this);
+        checkTransfers = Simulator::Schedule(MilliSeconds(protocol.chunkRetryTimeout), &EdgeAwareClientApplication::CheckTransfers, this);
+        if(payloadBytes > 0) {
+            writePayloads = Simulator::Schedule(first + Seconds(1), &EdgeAwareClientApplication::WritePayloads, this);
+        }
+    }
 
-        return mesg;
+    void StopTimers() {
+        Simulator::Cancel(sendEvent);
+        Simulator::Cancel(pruneLocalGroup);
+        Simulator::Cancel(checkNearbyElements);
+        Simulator::Cancel(checkTransfers);
+        Simulator::Cancel(dataRadioEvent);
+        Simulator::Cancel(dataSleepEvent);
+        Simulator::Cancel(writePayloads);
     }
 
-    static ADVERT_Message deserialize(std::vector<uint8_t> *buf) {
-        std::vector<uint8_t> oid(buf->begin() + 1, buf->begin() + 5);
-        nodeId_t otherId = oneByteToFour(&oid);
-        
-        std::vector<uint8_t> oip(buf->begin() + 5, buf->begin() + 9);
-        uint32_t otherIP = oneByteToFour(&oip);
-        
-        std::vector<elementId_t> otherElements;
-        otherElements.reserve((buf->size()-9)/3);
-        
-        std::vector<elementId_t> otherVersions;
-        otherVersions.reserve(otherElements.size());
-        
-        std::vector<elementId_t> otherRounds;
-        otherRounds.reserve(otherElements.size());
-        
-        for(size_t idx = 9; idx < buf->size(); idx+=3) {
-            // recall that the message is structured as:
-            // element id - version number - round number
-            otherElements.push_back(buf->at(idx));
-            otherVersions.push_back(buf->at(idx+1));
-            otherRounds.push_back(buf->at(idx+2));
+    // the churn model. a node stays up for a session drawn from sessionTime, then drops out for a
+    // downtime drawn from downtime with both radios asleep and everything in flight lost, and
+    // comes back through PeerProtocol::Rejoin: keeping its state, or starting over with coldRejoin.
+    // from then until it has caught up it counts the bytes it sends and receives
+    void GoOffline() {
+        NS_LOG_INFO("node " << node_id << " goes offline at " << Simulator::Now().GetSeconds());
+        online = false;
+        if(awaitingRecovery) {
+            unrecovered++;
+            awaitingRecovery = false;
         }
-        return ADVERT_Message(otherId, otherIP, &otherElements, &otherVersions, &otherRounds);
+        StopTimers();
+        dataQueue.clear();
+        dataPhy->SetSleepMode();
+        beaconPhy->SetSleepMode();
+        dataAwake = false;
+        churnEvent = Simulator::Schedule(Seconds(downtime->GetValue()), &EdgeAwareClientApplication::ComeOnline, this);
     }
 
-    friend std::ostream& operator<< (std::ostream &os, ADVERT_Message &a) {
-        os << "Id: " << unsigned(a.senderId) << "\nAddress: " << unsigned(a.ipv4Address)  << std::endl;
-        for(size_t idx = 0; idx < a.elements.size(); idx++) {
-            os << "Element: " << unsigned(a.elements.at(idx)) << " Version: " << unsigned(a.versions.at(idx)) << " Round: " << unsigned(a.rounds.at(idx)) << std::endl;
+    void ComeOnline() {
+        NS_LOG_INFO("node " << node_id << " comes back at " << Simulator::Now().GetSeconds());
+        online = true;
+        beaconPhy->ResumeFromSleep();
+        if(dataPeriod == 0) {
+            dataPhy->ResumeFromSleep();
+            dataAwake = true;
         }
-        return os;
+        protocol.Rejoin(Simulator::Now().GetMilliSeconds(), !coldRejoin);
+        awaitingRecovery = true;
+        recoveryBytes = 0;
+        // beacon straight away, so neighbors hear of us before we ask them anything
+        StartTimers(Seconds(0));
+        churnEvent = Simulator::Schedule(Seconds(sessionTime->GetValue()), &EdgeAwareClientApplication::GoOffline, this);
     }
 
-private:
-
-};
-
-/* FORMAT
- * | type   | nodeid |element |
- *
- * | 8 bit  | 32 bit | 8 bit  |
- *
- */
-class REQUEST_DATA_Message {
-public:
-    nodeId_t senderId;
-    elementId_t elementId;
-  
-    REQUEST_DATA_Message(nodeId_t nid, elementId_t eid): senderId(nid), elementId(eid) {
-    }
-  
-    std::vector<uint8_t> serialize() { 
-        std::vector<uint8_t> oid = fourByteToOne(this->senderId);
-        std::vector<uint8_t> mesg{REQUEST_DATA};
-        mesg.insert(mesg.end(), oid.begin(), oid.end());
-        mesg.push_back(this->elementId);
-        return mesg;
-    } 
-  
-    static REQUEST_DATA_Message deserialize(std::vector<uint8_t> *buf) { 
-        std::vector<uint8_t> oid(buf->begin() + 1, buf->begin() + 5);
-        nodeId_t otherId = oneByteToFour(&oid);
-        elementId_t elid = buf->at(5);
-        return REQUEST_DATA_Message(otherId, elid);
+    void GetNearbyElements() {
+        Ptr<Node> node = GetNode();
+        Vector3D nodePosition = node->GetObject<MobilityModel>()->GetPosition();
+        // NS_LOG_INFO(nodePosition);
+        protocol.UpdateNearbyElements(nodePosition.x, nodePosition.y, Simulator::Now().GetMilliSeconds());
+        checkNearbyElements = Simulator::Schedule(Seconds(1), &EdgeAwareClientApplication::GetNearbyElements, this);   
     }
-    
-    friend std::ostream& operator<< (std::ostream &os, REQUEST_DATA_Message &r) {
-        os << "Id: " << unsigned(r.senderId) << "\nElement: " << unsigned(r.elementId)  << std::endl;
-        return os;
+
+    // this function runs every three seconds, and prunes the nodes from the local group that have not been responsive for 10 seconds
+    void CheckHeartbeats() {
+        protocol.CheckHeartbeats(Simulator::Now().GetMilliSeconds());
+        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeAwareClientApplication::CheckHeartbeats, this);
     }
-};
-/* FORMAT
- * |type    |nodeid  |element |
- * |x pos   |y pos   |
- * |version |round   |
- * |members |...
- *
- * |8 bit   |32 bit  |8 bit   |
- * |32 bit  |32 bit  |
- * |8 bit   |8 bit   |
- * |32 bit  |...
- *
- */
-class SEND_DATA_Message {
-public:
-    nodeId_t senderId;
-    elementId_t elementId;
-    location_t xpos, ypos;
-    causalNum_t version, round;
-  
-    std::vector<nodeId_t> sync_group;
-  
-    SEND_DATA_Message(nodeId_t nid,
-            elementId_t eid,
-            location_t x,
-            location_t y,
-            causalNum_t ver,
-            causalNum_t rnd,
-            std::set<nodeId_t> *sg):
-        senderId(nid), elementId(eid), xpos(x), ypos(y), version(ver), round(rnd), sync_group(sg->size())
-    {
-        sync_group.assign(sg->begin(), sg->end());
+
+    // retransmits unacknowledged chunks of large SEND_DATAs
+    void CheckTransfers() {
+        protocol.CheckTransfers(Simulator::Now().GetMilliSeconds());
+        checkTransfers = Simulator::Schedule(MilliSeconds(protocol.chunkRetryTimeout), &EdgeAwareClientApplication::CheckTransfers, this);
     }
-  
-    std::vector<uint8_t> serialize() {
-        std::vector<uint8_t> mesg{SEND_DATA};
-        std::vector<uint8_t> oid = fourByteToOne(this->senderId);
-        mesg.insert(mesg.end(), oid.begin(), oid.end());
-        mesg.push_back(this->elementId);
-  
-        uint32_t serialized_xpos = *reinterpret_cast<uint32_t*>(&this->xpos);
-        uint32_t serialized_ypos = *reinterpret_cast<uint32_t*>(&this->ypos);
-  
-        std::vector<uint8_t> packed_x = fourByteToOne(serialized_xpos);
-        std::vector<uint8_t> packed_y = fourByteToOne(serialized_ypos);
-  
-        mesg.insert(mesg.end(), packed_x.begin(), packed_x.end());
-        mesg.insert(mesg.end(), packed_y.begin(), packed_y.end());
-  
-        mesg.push_back(this->version);
-        mesg.push_back(this->round);
-  
-        for(nodeId_t nodeId : this->sync_group) {
-            std::vector<uint8_t> id = fourByteToOne(nodeId);
-            mesg.insert(mesg.end(), id.begin(), id.end());
+
+    void ReceiveData(Ptr<Socket> socket) {
+        Ptr<Packet> packet = socket->Recv();
+        if(!online) {
+            return;
         }
-  
-        return mesg;
-      }
-    static SEND_DATA_Message deserialize(std::vector<uint8_t> *buf) {
-        std::vector<uint8_t> oid(buf->begin() + 1, buf->begin() + 5);
-        nodeId_t otherId = oneByteToFour(&oid);
-  
-        elementId_t elid = buf->at(5);
-  
-        std::vector<uint8_t> px(buf->begin() + 6, buf->begin() + 10);
-        std::vector<uint8_t> py(buf->begin() + 10, buf->begin() + 14);
-  
-        uint32_t packed_x = oneByteToFour(&px);
-        uint32_t packed_y = oneByteToFour(&py);
-  
-        location_t xpos = *reinterpret_cast<location_t*>(&packed_x);
-        location_t ypos = *reinterpret_cast<location_t*>(&packed_y);
-  
-        causalNum_t vers = buf->at(14);
-        causalNum_t rnd = buf->at(15);
-  
-        std::set<nodeId_t> sync_group;
-        for(size_t idx = 16; idx < buf->size(); idx+=4) {
-            std::vector<uint8_t> syn(buf->begin() + idx, buf->begin() + idx + 4);
-            nodeId_t sync_nodeId = oneByteToFour(&syn);
-            sync_group.insert(sync_nodeId);
+        uint32_t dataSize = packet->GetSize();
+        // the receive buffer keeps its capacity between packets
+        rxBuffer.resize(dataSize);
+        packet->CopyData(rxBuffer.data(), dataSize);
+        // NS_LOG_INFO("" << node_id << " received data");
+        protocol.ReceiveMessage(rxBuffer.data(), dataSize, Simulator::Now().GetMilliSeconds());
+        if(awaitingRecovery) {
+            recoveryBytes += dataSize;
+            if(!protocol.is_recovering()) {
+                NS_LOG_INFO("node " << node_id << " caught up after " << protocol.get_lastRecovery() << " ms and " << recoveryBytes << " bytes");
+                recoveries.emplace_back(protocol.get_lastRecovery(), recoveryBytes);
+                awaitingRecovery = false;
+            }
         }
-        return SEND_DATA_Message(otherId, elid, xpos, ypos, vers, rnd, &sync_group);
     }
-    
-    friend std::ostream& operator<< (std::ostream &os, SEND_DATA_Message &s) {
-            os << "Id: " << unsigned(s.senderId) << "\nElement: " << unsigned(s.elementId)  << std::endl;
-            os << "Location: (" << s.xpos << ", " << s.ypos << ")\n";
-            os << "Version: " << unsigned(s.version) << " Round: " << unsigned(s.round) << std::endl;
-            for(nodeId_t elem : s.sync_group) {
-                os << "Node: " << elem << std::endl;
-            }
-            return os;
+
+    // the data radio batching scheduler. every node wakes its data radio for the first dataWindow
+    // milliseconds of each dataPeriod; the windows line up across nodes (the simulation clock stands
+    // in for the synchronized clocks phones have), so whatever one node sends in a window the others
+    // are awake to hear, and a request, its SEND_DATA and the ACK usually fit in one. anything the
+    // protocol produces while the radio sleeps, mostly requests prompted by beacons, is queued and
+    // goes out together at the start of the next window. the radio then wakes up once a period rather
+    // than once per message, and sleeps rather than idles in between. a dataPeriod of 0 leaves the
+    // data radio on all the time
+    void WakeDataRadio() {
+        dataPhy->ResumeFromSleep();
+        dataAwake = true;
+        dataWakeups++;
+        for(const auto &queued : dataQueue) {
+            dataSendSocket->SendTo(queued.second, 0, InetSocketAddress(Ipv4Address(queued.first), 8080));
         }
-};
+        dataQueue.clear();
+        dataSleepEvent = Simulator::Schedule(MilliSeconds(dataWindow), &EdgeAwareClientApplication::SleepDataRadio, this);
+        dataRadioEvent = Simulator::Schedule(MilliSeconds(dataPeriod), &EdgeAwareClientApplication::WakeDataRadio, this);
+    }
 
-class ACK_Message {
-public:
-    nodeId_t senderId;
-    elementId_t elementId;
-  
-    ACK_Message(nodeId_t nid, elementId_t eid): senderId(nid), elementId(eid) {
+    // the phy finishes a transmission in progress before it goes to sleep
+    void SleepDataRadio() {
+        dataPhy->SetSleepMode();
+        dataAwake = false;
     }
-  
-    std::vector<uint8_t> serialize() { 
-        std::vector<uint8_t> oid = fourByteToOne(this->senderId);
-        std::vector<uint8_t> mesg{ACK};
-        mesg.insert(mesg.end(), oid.begin(), oid.end());
-        mesg.push_back(this->elementId);
-        return mesg;
-    } 
-  
-    static ACK_Message deserialize(std::vector<uint8_t> *buf) { 
-        std::vector<uint8_t> oid(buf->begin() + 1, buf->begin() + 5);
-        nodeId_t otherId = oneByteToFour(&oid);
-        elementId_t elid = buf->at(5);
-        return ACK_Message(otherId, elid);
+
+    // the feature data workload: the first time round this node writes payloadBytes of random data
+    // to each element it is near, and every 5 s after that it overwrites 64 bytes of it somewhere,
+    // so the others only need to fetch the chunk or two around the edit
+    void WritePayloads() {
+        for(elementId_t element : protocol.get_nearbyElements()) {
+            std::vector<uint8_t> &data = payloads[element];
+            size_t edit = data.empty() ? 0 : (size_t)payloadRandom->GetValue(0, data.size() - std::min<size_t>(64, data.size()));
+            size_t length = data.empty() ? payloadBytes : std::min<size_t>(64, data.size());
+            data.resize(payloadBytes);
+            for(size_t idx = edit; idx < edit + length; idx++) {
+                data[idx] = (uint8_t)payloadRandom->GetValue(0, 256);
+            }
+            if(!protocol.SetPayload(element, data.data(), data.size(), Simulator::Now().GetMilliSeconds())) {
+                NS_LOG_WARN("node " << node_id << " could not write element " << unsigned(element) << ": out of versions or a chunk hash collision");
+            }
+        }
+        writePayloads = Simulator::Schedule(Seconds(5), &EdgeAwareClientApplication::WritePayloads, this);
     }
-    
-    friend std::ostream& operator<< (std::ostream &os, ACK_Message &a) {
-        os << "Id: " << unsigned(a.senderId) << "\nElement: " << unsigned(a.elementId)  << std::endl;
-        return os;
+
+    // beacons go out on the beacon radio, but carry our data radio address for replies
+    void SendAdvertisement() {
+        Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
+        Ipv4Address address = ipv4->GetAddress(DataInterface, 0).GetLocal();
+        // a large advert goes out as several parts, back to back
+        size_t parts = protocol.AdvertisementParts();
+        for(size_t part = 0; part < parts; part++) {
+            const std::vector<uint8_t> &mesg = protocol.BuildAdvertisement(address.Get(), part);
+            if(awaitingRecovery) {
+                recoveryBytes += mesg.size();
+            }
+            Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
+            broadcastSendSocket->Send(packet);
+        }
+        sendEvent = Simulator::Schedule(Time("1s"), &EdgeAwareClientApplication::SendAdvertisement, this);
     }
+
+    Ptr<Socket> dataSendSocket, dataRecvSocket, broadcastSendSocket, broadcastRecvSocket;
+    EventId sendEvent, checkNearbyElements, pruneLocalGroup, checkTransfers, dataRadioEvent, dataSleepEvent, writePayloads, churnEvent;
+    std::shared_ptr<const ElementCatalog> catalog;
+    PeerProtocol protocol;
+    uint32_t pushFanout;
+    // data radio batching, in milliseconds; see WakeDataRadio
+    uint32_t dataPeriod, dataWindow;
+    Ptr<WifiPhy> dataPhy, beaconPhy;
+    bool dataAwake;
+    std::vector<std::pair<uint32_t, Ptr<Packet>>> dataQueue;
+    uint32_t dataWakeups = 0;
+    std::vector<uint8_t> rxBuffer;
+    std::vector<uint8_t> warmState;
+    // the feature data this node writes, by element; see WritePayloads
+    uint32_t payloadBytes = 0;
+    std::map<elementId_t, std::vector<uint8_t>> payloads;
+    Ptr<UniformRandomVariable> payloadRandom;
+    // churn, see GoOffline. without sessionTime the node stays up
+    Ptr<RandomVariableStream> sessionTime, downtime;
+    bool coldRejoin = false;
+    bool online = true;
+    bool awaitingRecovery = false;
+    uint64_t recoveryBytes = 0;
+    std::vector<std::pair<int64_t, uint64_t>> recoveries;
+    uint32_t unrecovered = 0;
+    nodeId_t node_id;
 };
 
-class EdgeAwareClientApplication : public ns3::Application {
+// an edge server, as in src/README.txt. there are --edges of them, each plugged in and standing
+// still, so both radios stay on, and they are wired to each other by a backhaul LAN. an edge runs the same protocol as the peers, near exactly the elements it owns under the
+// current EdgePartition: it beacons them, pulls newer states of them from the peers in reach and
+// serves them to the peers that pull from it. when the partition changes it hands the elements it
+// lost to their new owners over the backhaul, and takes up the ones it gained once their states
+// have come in, or after transferTimeout if they never do
+class EdgeServerApplication : public ns3::Application, public PeerTransport {
 public:
-    EdgeAwareClientApplication() {}
-   
-    uint32_t heartbeatTimeout = 10000;
+    EdgeServerApplication() {}
 
-    void Setup(Ptr<Socket> dataSendSocket_, 
-                Ptr<Socket> dataRecvSocket_, 
+    void Setup(Ptr<Socket> dataSendSocket_,
+                Ptr<Socket> dataRecvSocket_,
                 Ptr<Socket> broadcastSendSocket_,
-                Ptr<Socket> broadcastRecvSocket_) 
+                Ptr<Socket> broadcastRecvSocket_,
+                Ptr<Socket> backhaulSocket_,
+                std::shared_ptr<const ElementCatalog> catalog_,
+                std::shared_ptr<const EdgePartition> partition_,
+                uint32_t pushFanout_)
     {
+        catalog = catalog_;
+        partition = partition_;
+        pushFanout = pushFanout_;
         dataSendSocket = dataSendSocket_;
         dataRecvSocket = dataRecvSocket_;
         broadcastSendSocket = broadcastSendSocket_;
         broadcastRecvSocket = broadcastRecvSocket_;
-        broadcastRecvSocket->SetRecvCallback(MakeCallback(&EdgeAwareClientApplication::ReceiveData, this));    
-        dataRecvSocket->SetRecvCallback(MakeCallback(&EdgeAwareClientApplication::ReceiveData, this));
+        backhaulSocket = backhaulSocket_;
+        broadcastRecvSocket->SetRecvCallback(MakeCallback(&EdgeServerApplication::ReceiveData, this));
+        dataRecvSocket->SetRecvCallback(MakeCallback(&EdgeServerApplication::ReceiveData, this));
+        backhaulSocket->SetRecvCallback(MakeCallback(&EdgeServerApplication::ReceiveData, this));
     }
 
-    // All the setup for the ports and sockets done here
+    // where every edge, this one included, is on the backhaul, by node id
+    void SetBackhaul(std::map<nodeId_t, uint32_t> addresses) { backhaul = std::move(addresses); }
+
     void StartApplication() {
         Ptr<Node> node = GetNode();
         node_id = node->GetId();
 
-        auto unif_rv = CreateObject<UniformRandomVariable>(); 
-        unif_rv->SetAttribute("Min", DoubleValue(-0.5));
-        unif_rv->SetAttribute("Max", DoubleValue(0.5));
- 
-        std::vector<std::pair<location_t, location_t>> baseElementLocations{
-            {2.5f, 5.5f},
-            {1.0f, 4.0f},
-            {3.0f, 6.5f},
-            {5.0f, 9.0f},
-            {6.0f, 2.5f}
-        };
-        for(auto &elem : baseElementLocations) {
-            elem = std::pair<location_t, location_t>(elem.first + unif_rv->GetValue(), elem.second + unif_rv->GetValue());
-        }
-        
-        for(std::pair<location_t, location_t> &element : baseElementLocations) {
-            AgreementInformation_vec.push_back(AgreementInformation(&element, node_id));
-        } 
- 
-        NS_LOG_INFO("Starting state for node " << node_id << ": ");
-        for(auto elem : AgreementInformation_vec) {
-            NS_LOG_INFO(elem);
-        }
-        NS_LOG_INFO("");
-
-        sendEvent = Simulator::Schedule(Seconds(1), &EdgeAwareClientApplication::SendAdvertisement, this);
-        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeAwareClientApplication::CheckHeartbeats, this);
-        checkNearbyElements = Simulator::Schedule(Seconds(1), &EdgeAwareClientApplication::GetNearbyElements, this);   
+        protocol.Setup(node_id, this, catalog);
+        auto unif_rv = CreateObject<UniformRandomVariable>();
+        unif_rv->SetAttribute("Min", DoubleValue(-protocol.locationNoiseRange));
+        unif_rv->SetAttribute("Max", DoubleValue(protocol.locationNoiseRange));
+        protocol.locationNoise = [unif_rv]() { return (location_t)unif_rv->GetValue(); };
+        protocol.pushFanout = pushFanout;
+        auto push_rv = CreateObject<UniformRandomVariable>();
+        protocol.pushRandom = [push_rv]() { return push_rv->GetValue(); };
+        protocol.edgePartition = partition;
+        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+        protocol.maxMessageSize = std::min(ipv4->GetMtu(DataInterface), ipv4->GetMtu(BackhaulInterface)) - 28;
+
+        owned = partition->get_owned(node_id);
+        protocol.SetNearbyElements(owned, Simulator::Now().GetMilliSeconds());
+        NS_LOG_INFO("Starting edge " << node_id << " owning " << owned.size() << " of " << catalog->size() << " elements");
+
+        sendEvent = Simulator::Schedule(Seconds(0), &EdgeServerApplication::SendAdvertisement, this);
+        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeServerApplication::CheckHeartbeats, this);
+        checkTransfers = Simulator::Schedule(MilliSeconds(protocol.chunkRetryTimeout), &EdgeServerApplication::CheckTransfers, this);
     }
 
     void StopApplication() {
-        // we need to unbind things here
-        NS_LOG_INFO("Ending state for node " << node_id << ": ");
-        for(auto elem : AgreementInformation_vec) {
-            NS_LOG_INFO(elem);
+        Simulator::Cancel(sendEvent);
+        Simulator::Cancel(pruneLocalGroup);
+        Simulator::Cancel(checkTransfers);
+    }
+
+    // PeerTransport: handoffs to other edges go over the backhaul, everything else on the data radio
+    void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+        bytesOut += mesg.size();
+        Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
+        Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
+        Ipv4InterfaceAddress ours = ipv4->GetAddress(BackhaulInterface, 0);
+        if(Ipv4Address(address).CombineMask(ours.GetMask()) == ours.GetLocal().CombineMask(ours.GetMask())) {
+            backhaulSocket->SendTo(packet, 0, InetSocketAddress(Ipv4Address(address), 8080));
+            return;
         }
-        NS_LOG_INFO("");
+        dataSendSocket->SendTo(packet, 0, InetSocketAddress(Ipv4Address(address), 8080));
     }
 
-private:
-    void GetNearbyElements() {
-        Ptr<Node> node = GetNode();
-        Vector3D nodePosition = node->GetObject<MobilityModel>()->GetPosition();
-        // NS_LOG_INFO(nodePosition);
-        location_t distance = 8.0f;
-        //iterate through the elements in the table, see which ones youre close to (according to AgreementInformation_vec.get(i).fineLocation), add them to nearbyElements
-        //if you are far from an element, attempt to remove it from nearbyElements
-        for(size_t idx = 0; idx < AgreementInformation_vec.size(); idx++) {
-            location_t xdiff = pow(AgreementInformation_vec.at(idx).get_fineLocation().first - nodePosition.x, 2);
-            location_t ydiff = pow(AgreementInformation_vec.at(idx).get_fineLocation().second - nodePosition.y, 2);
-            if(xdiff + ydiff < pow(distance, 2)) {
-                if(nearbyElements.count(idx) == 0) {
-                    BeginAgreement((elementId_t)idx);
-                }
-                nearbyElements.insert((elementId_t) idx);   
+    // moves to a new partition: the elements this edge no longer owns go to their new owners, one
+    // handoff per owner, and the ones it now owns are waited for, see TakePending
+    void Repartition(std::shared_ptr<const EdgePartition> next) {
+        int64_t now = Simulator::Now().GetMilliSeconds();
+        const std::vector<elementId_t> &nowOwned = next->get_owned(node_id);
+        std::map<nodeId_t, std::vector<elementId_t>> lost;
+        std::vector<elementId_t> kept;
+        for(elementId_t element : owned) {
+            if(std::binary_search(nowOwned.begin(), nowOwned.end(), element)) {
+                kept.push_back(element);
             }
             else {
-                nearbyElements.erase((elementId_t) idx);
+                lost[next->OwnerOf(element)].push_back(element);
             }
         }
-        checkNearbyElements = Simulator::Schedule(Seconds(1), &EdgeAwareClientApplication::GetNearbyElements, this);   
-    }
- 
-    void BeginAgreement(elementId_t element) {
-        causalNum_t ourVersion = AgreementInformation_vec.at(element).get_version();
-        causalNum_t ourRound = AgreementInformation_vec.at(element).get_round();
-        
-        causalNum_t maxVersion = 0;
-        causalNum_t maxRound = 0;
-        nodeId_t bestNode = UINT32_MAX;
-        bool no_version = AgreementInformation_vec.at(element).get_round() == 0;
-        NS_LOG_INFO("node " << node_id << " is beginning agreement");
-        if(!localGroup.empty()) {
-            for(auto node : localGroup) {       
-                uint32_t theirVersion = node.second.versionRoundNumbers.at(element).first;
-                uint32_t theirRound = node.second.versionRoundNumbers.at(element).second;
-
-                if( theirVersion > maxVersion || (theirVersion == maxVersion && theirRound > maxRound) ) {
-                    maxVersion = theirVersion;
-                    maxRound = theirRound;
-                    bestNode = node.first;
-                }
+        for(elementId_t element : nowOwned) {
+            if(!std::binary_search(owned.begin(), owned.end(), element)) {
+                pending.push_back(element);
             }
-            if(ourVersion < maxVersion || (ourVersion == maxVersion && ourRound < maxRound)) {
-                NS_LOG_INFO("replacement found for element " << unsigned(element) << " from node " << bestNode);
-                SendDataRequest(localGroup.at(bestNode).address, element);
+        }
+        for(const auto &handoff : lost) {
+            auto address = backhaul.find(handoff.first);
+            if(address == backhaul.end()) {
+                NS_LOG_WARN("edge " << node_id << " has nowhere to hand " << handoff.second.size() << " elements to");
+                kept.insert(kept.end(), handoff.second.begin(), handoff.second.end());
+                continue;
+            }
+            NS_LOG_INFO("edge " << node_id << " hands " << handoff.second.size() << " elements to edge " << handoff.first);
+            protocol.HandOff(handoff.second, handoff.first, address->second, now);
+            handedOff += handoff.second.size();
+        }
+        std::sort(kept.begin(), kept.end());
+        owned.swap(kept);
+        pendingSince = now;
+        partition = next;
+        protocol.edgePartition = next;
+        protocol.SetNearbyElements(owned, now);
+        TakePending();
+    }
+
+    const PeerProtocol& get_protocol() const { return protocol; }
+    const std::vector<elementId_t>& get_owned() const { return owned; }
+    uint64_t get_messagesIn() const { return messagesIn; }
+    uint64_t get_bytesIn() const { return bytesIn; }
+    uint64_t get_bytesOut() const { return bytesOut; }
+    uint32_t get_handedOff() const { return handedOff; }
+
+private:
+    // takes up the elements gained in a repartition whose states have arrived from their old
+    // owner. after transferTimeout the rest are taken up anyway and start over
+    void TakePending() {
+        if(pending.empty()) {
+            return;
+        }
+        bool expired = Simulator::Now().GetMilliSeconds() - pendingSince >= protocol.transferTimeout;
+        size_t before = owned.size();
+        for(auto it = pending.begin(); it != pending.end();) {
+            if(expired || protocol.get_AgreementInformation().count(*it) > 0) {
+                owned.push_back(*it);
+                it = pending.erase(it);
             }
             else {
-                NS_LOG_INFO("replacement not found for element " << unsigned(element));
-                if(no_version) {
-                    AgreementInformation_vec.at(element).set_round(node_id+1);
-                    NS_LOG_INFO("initialized to " << (node_id+1));
-                }
+                ++it;
             }
         }
-        else {
-            NS_LOG_INFO("found " << unsigned(element) << " but, empty local group");
-            if(no_version) {
-                AgreementInformation_vec.at(element).set_round(node_id+1);
-                NS_LOG_INFO("initialized to " << (node_id+1));
-            }
+        if(owned.size() != before) {
+            std::sort(owned.begin(), owned.end());
+            protocol.SetNearbyElements(owned, Simulator::Now().GetMilliSeconds());
         }
     }
 
-    // this function runs every five seconds, and iterates over the list of nodes
-    // it prunes the nodes from the local group that have not been responsive for 10 seconds
     void CheckHeartbeats() {
-        std::vector<uint32_t> deletionSet;
-        deletionSet.reserve(2);
-        uint32_t currentTime = Simulator::Now().GetMilliSeconds();
-        for(auto localGroupNodePair : localGroup) {
-            if(currentTime - localGroupNodePair.second.recentTime >= heartbeatTimeout) {
-                deletionSet.push_back(localGroupNodePair.first);
-            } 
-        }
-        for(uint32_t key : deletionSet) {
-            localGroup.erase(key);
-        }
-        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeAwareClientApplication::CheckHeartbeats, this);
+        protocol.CheckHeartbeats(Simulator::Now().GetMilliSeconds());
+        pruneLocalGroup = Simulator::Schedule(Seconds(3), &EdgeServerApplication::CheckHeartbeats, this);
+    }
+
+    void CheckTransfers() {
+        protocol.CheckTransfers(Simulator::Now().GetMilliSeconds());
+        TakePending();
+        checkTransfers = Simulator::Schedule(MilliSeconds(protocol.chunkRetryTimeout), &EdgeServerApplication::CheckTransfers, this);
     }
 
     void ReceiveData(Ptr<Socket> socket) {
         Ptr<Packet> packet = socket->Recv();
         uint32_t dataSize = packet->GetSize();
-        uint8_t buffer[dataSize];
-        packet->CopyData(buffer, dataSize);
-        // NS_LOG_INFO("" << node_id << " received data");
+        rxBuffer.resize(dataSize);
+        packet->CopyData(rxBuffer.data(), dataSize);
+        messagesIn++;
+        bytesIn += dataSize;
+        protocol.ReceiveMessage(rxBuffer.data(), dataSize, Simulator::Now().GetMilliSeconds());
+        TakePending();
+    }
 
-        // because of how we serialize, the first byte is the message type 
-        std::vector<uint8_t> vectorized_buffer(buffer, buffer + sizeof(buffer)/sizeof(buffer[0])); 
-        if(buffer[0] == ADVERT) {
-            //NS_LOG_INFO("Received advertisement");
-            ADVERT_Message info = ADVERT_Message::deserialize(&vectorized_buffer);
-            //NS_LOG_INFO(info);
-            nodeEntry thisNode(Ipv4Address(info.ipv4Address), Simulator::Now().GetMilliSeconds());
-            bool queueBeginAgreement = false;
-            std::vector<elementId_t> agree;
-
-            for(size_t idx = 0; idx < info.elements.size(); idx++) {
-                causalNum_t theirVersion = info.versions.at(idx);
-                causalNum_t theirRound = info.rounds.at(idx);
-
-                causalNum_t ourVersion = AgreementInformation_vec.at(info.elements.at(idx)).get_version();
-                causalNum_t ourRound = AgreementInformation_vec.at(info.elements.at(idx)).get_round();
-
-                if(nearbyElements.count(info.elements.at(idx))==1) {
-                    if(theirVersion > ourVersion || (theirVersion == ourVersion && theirRound > ourRound)) {
-                        NS_LOG_INFO("node " << node_id << " saw " << info.senderId << ", a better node for nearby element " << unsigned(info.elements.at(idx)));
-                        queueBeginAgreement = true;
-                        agree.push_back(info.elements.at(idx));
-                    }
-                }
-                thisNode.versionRoundNumbers.at(info.elements.at(idx)) = std::pair<causalNum_t, causalNum_t>(theirVersion, theirRound);
-            }
-            localGroup.insert_or_assign(info.senderId, thisNode);
-            if(queueBeginAgreement) {
-                for(auto elem : agree) {
-                    BeginAgreement(elem);
-                }
-            }
-        }
-        else if(buffer[0] == REQUEST_DATA) {
-            //NS_LOG_INFO("Received data request");
-            REQUEST_DATA_Message info = REQUEST_DATA_Message::deserialize(&vectorized_buffer);
-            Ipv4Address address = localGroup.at(info.senderId).address;
-            SendData(address, info.elementId);
+    void SendAdvertisement() {
+        Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
+        Ipv4Address address = ipv4->GetAddress(DataInterface, 0).GetLocal();
+        size_t parts = protocol.AdvertisementParts();
+        for(size_t part = 0; part < parts; part++) {
+            const std::vector<uint8_t> &mesg = protocol.BuildAdvertisement(address.Get(), part);
+            bytesOut += mesg.size();
+            broadcastSendSocket->Send(Create<Packet>(mesg.data(), mesg.size()));
         }
-        else if(buffer[0] == SEND_DATA) { 
-            //NS_LOG_INFO("Received data");
-            SEND_DATA_Message info = SEND_DATA_Message::deserialize(&vectorized_buffer);
+        sendEvent = Simulator::Schedule(Time("1s"), &EdgeServerApplication::SendAdvertisement, this);
+    }
+
+    Ptr<Socket> dataSendSocket, dataRecvSocket, broadcastSendSocket, broadcastRecvSocket, backhaulSocket;
+    EventId sendEvent, pruneLocalGroup, checkTransfers;
+    std::shared_ptr<const ElementCatalog> catalog;
+    std::shared_ptr<const EdgePartition> partition;
+    std::map<nodeId_t, uint32_t> backhaul;
+    PeerProtocol protocol;
+    uint32_t pushFanout;
+    // owned is sorted; pending holds the elements gained in the last repartition not taken up yet
+    std::vector<elementId_t> owned, pending;
+    int64_t pendingSince = 0;
+    std::vector<uint8_t> rxBuffer;
+    uint64_t messagesIn = 0, bytesIn = 0, bytesOut = 0;
+    uint32_t handedOff = 0;
+    nodeId_t node_id;
+};
 
-            AgreementInformation *elementInfo = &AgreementInformation_vec.at(info.elementId);
+/* FORMAT of a snapshot file
+ * |8 byte magic "PEERSNAP"|32 bit rng seed|64 bit rng run, high word first|32 bit node count|
+ * then per peer, in node order (edge servers are not included):
+ * |32 bit x|32 bit y|32 bit z| (floats)
+ * |32 bit state length|PeerProtocol::SaveState|
+ */
+struct Snapshot {
+    uint32_t seed;
+    uint64_t run;
+    std::vector<Vector> positions;
+    std::vector<std::vector<uint8_t>> states;
+};
 
-            std::set<nodeId_t> agreeset(info.sync_group.begin(), info.sync_group.end());
-            elementInfo->set_version(info.version);
-            elementInfo->set_round(info.round);
-            if(agreeset.count(node_id) == 0) {
-                elementInfo->set_round(elementInfo->get_round()+1);
-            }
-            agreeset.insert(node_id);
-            elementInfo->set_agreeingNodes(&agreeset);
-            std::pair<location_t, location_t> tmp(info.xpos, info.ypos);
-            elementInfo->set_fineLocation(&tmp);
-            
-            Ipv4Address address = localGroup.at(info.senderId).address;
-            SendACK(address, info.elementId);
-        }
-        else if(buffer[0] == ACK) {
-            // NS_LOG_INFO("Received ACK");
-            ACK_Message info = ACK_Message::deserialize(&vectorized_buffer);
-             
-            AgreementInformation *elementInfo = &AgreementInformation_vec.at(info.elementId);
-            if(elementInfo->count_agreeingNodes(info.senderId) == false) {
-                elementInfo->set_round(elementInfo->get_round()+1);
-                elementInfo->add_agreeingNodes(info.senderId);
-            }
-        }
-        else {
-            NS_LOG_INFO("INVALID MESSAGE");
-        }   
-    }
+static const char SnapshotMagic[8] = {'P', 'E', 'E', 'R', 'S', 'N', 'A', 'P'};
 
-    // This should be triggered by adding it to the simulator schedule as in line 23
-    void SendAdvertisement() {
-        Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
-        Ipv4Address address = ipv4->GetAddress(1, 0).GetLocal();
-        uint32_t ipv4_num = address.Get();
-        ADVERT_Message adv(node_id, ipv4_num, &nearbyElements, &AgreementInformation_vec);
-        
-        //NS_LOG_INFO(adv);
-        std::vector<uint8_t> mesg = adv.serialize();
-        Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
-        broadcastSendSocket->Send(packet);
-        sendEvent = Simulator::Schedule(Time("1s"), &EdgeAwareClientApplication::SendAdvertisement, this);
+static void fourByteFloat(float f, std::vector<uint8_t> *out) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, 4);
+    fourByteToOne(bits, out);
+}
+
+static float floatFromFour(const uint8_t *c) {
+    uint32_t bits = oneByteToFour(c);
+    float f;
+    std::memcpy(&f, &bits, 4);
+    return f;
+}
+
+// saves every peer's position and protocol state, for a later run to warm start from. edge
+// servers are not saved; they start empty in the warm run and refill from the peers
+void WriteSnapshot(std::string path, NodeContainer nodes, std::vector<Ptr<EdgeAwareClientApplication>> apps) {
+    std::vector<uint8_t> out(SnapshotMagic, SnapshotMagic + sizeof(SnapshotMagic));
+    fourByteToOne(RngSeedManager::GetSeed(), &out);
+    uint64_t run = RngSeedManager::GetRun();
+    fourByteToOne((uint32_t)(run >> 32), &out);
+    fourByteToOne((uint32_t)run, &out);
+    fourByteToOne(apps.size(), &out);
+
+    std::vector<uint8_t> state;
+    int64_t now = Simulator::Now().GetMilliSeconds();
+    for(uint32_t n = 0; n < apps.size(); n++) {
+        Vector position = nodes.Get(n)->GetObject<MobilityModel>()->GetPosition();
+        fourByteFloat(position.x, &out);
+        fourByteFloat(position.y, &out);
+        fourByteFloat(position.z, &out);
+        apps[n]->get_protocol().SaveState(now, &state);
+        fourByteToOne(state.size(), &out);
+        out.insert(out.end(), state.begin(), state.end());
     }
-    
-    void SendDataRequest(Ipv4Address address, elementId_t elementId) {
-        REQUEST_DATA_Message req(node_id, elementId);
-        
-        std::vector<uint8_t> mesg = req.serialize();
-        Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
-        dataSendSocket->SendTo(packet, 0, InetSocketAddress(address, 8080));
-        //NS_LOG_INFO(gunk);
-    }
-
-    void SendData(Ipv4Address address, elementId_t elementId) {
-        AgreementInformation elem = AgreementInformation_vec.at(elementId);
-        std::set<nodeId_t> sync = elem.get_agreeingNodes();
-
-        SEND_DATA_Message send(
-                node_id,
-                elementId,
-                elem.get_fineLocation().first,
-                elem.get_fineLocation().second,
-                elem.get_version(),
-                elem.get_round(),
-                &sync);
-        
-        std::vector<uint8_t> mesg = send.serialize();
-        Ptr<Packet> packet = Create<Packet>(mesg.data(), mesg.size());
-        dataSendSocket->SendTo(packet, 0, InetSocketAddress(address, 8080));
+
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)out.data(), out.size());
+    if(!file) {
+        NS_FATAL_ERROR("could not write snapshot " << path);
     }
+    NS_LOG_INFO("Saved a snapshot of " << apps.size() << " nodes at " << Simulator::Now().GetSeconds() << "s to " << path);
+}
 
-    void SendACK(Ipv4Address address, elementId_t elementId) {
-        ACK_Message ack(node_id, elementId);
-        
-        std::vector<uint8_t> mesg = ack.serialize();
-        Ptr<Packet> packet = Create<Packet>((uint8_t*)mesg.data(), sizeof(mesg.data()));
-        dataSendSocket->SendTo(packet, 0, InetSocketAddress(address, 8080));
+Snapshot ReadSnapshot(std::string path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if(!file.is_open() || in.size() < 24 || !std::equal(SnapshotMagic, SnapshotMagic + sizeof(SnapshotMagic), in.begin())) {
+        NS_FATAL_ERROR("not a snapshot: " << path);
     }
 
-    Ptr<Socket> dataSendSocket, dataRecvSocket, broadcastSendSocket, broadcastRecvSocket;
-    EventId sendEvent, checkNearbyElements, pruneLocalGroup;
-    std::vector<AgreementInformation> AgreementInformation_vec;
-    std::set<elementId_t> nearbyElements;
-    std::map<nodeId_t, nodeEntry> localGroup;
-    nodeId_t node_id;
-}; 
+    Snapshot snapshot;
+    snapshot.seed = oneByteToFour(in.data() + 8);
+    snapshot.run = ((uint64_t)oneByteToFour(in.data() + 12) << 32) | oneByteToFour(in.data() + 16);
+    uint32_t count = oneByteToFour(in.data() + 20);
+    size_t pos = 24;
+    for(uint32_t n = 0; n < count; n++) {
+        if(in.size() - pos < 16) {
+            NS_FATAL_ERROR("snapshot " << path << " is truncated");
+        }
+        snapshot.positions.push_back(Vector(floatFromFour(&in[pos]), floatFromFour(&in[pos + 4]), floatFromFour(&in[pos + 8])));
+        uint32_t length = oneByteToFour(&in[pos + 12]);
+        pos += 16;
+        if(in.size() - pos < length) {
+            NS_FATAL_ERROR("snapshot " << path << " is truncated");
+        }
+        snapshot.states.emplace_back(in.begin() + pos, in.begin() + pos + length);
+        pos += length;
+    }
+    return snapshot;
+}
 
 void TracePackets(Ptr<const Packet> packet) {
     NS_LOG_INFO("Packet trace - Received packet at node: " << Simulator::Now().GetSeconds());
 }
 
+// durations in seconds for the churn model with the given mean: exponential, pareto (shape 2.5,
+// so a few sessions run much longer than the rest), uniform over [0, 2*mean] or constant
+static Ptr<RandomVariableStream> ChurnDistribution(const std::string &kind, double mean) {
+    if(kind == "exponential") {
+        auto rv = CreateObject<ExponentialRandomVariable>();
+        rv->SetAttribute("Mean", DoubleValue(mean));
+        return rv;
+    }
+    if(kind == "pareto") {
+        auto rv = CreateObject<ParetoRandomVariable>();
+        rv->SetAttribute("Shape", DoubleValue(2.5));
+        rv->SetAttribute("Scale", DoubleValue(mean * 1.5 / 2.5));
+        return rv;
+    }
+    if(kind == "uniform") {
+        auto rv = CreateObject<UniformRandomVariable>();
+        rv->SetAttribute("Min", DoubleValue(0));
+        rv->SetAttribute("Max", DoubleValue(2 * mean));
+        return rv;
+    }
+    if(kind == "constant") {
+        auto rv = CreateObject<ConstantRandomVariable>();
+        rv->SetAttribute("Constant", DoubleValue(mean));
+        return rv;
+    }
+    NS_FATAL_ERROR("unknown churn distribution " << kind);
+}
+
+// count edge sites spread evenly over a side x side area, one in the middle of each cell of a grid
+// as near square as count allows, with node ids from firstId on
+static std::vector<EdgePartition::Edge> EdgeSites(uint32_t count, nodeId_t firstId, double side) {
+    uint32_t columns = (uint32_t)std::ceil(std::sqrt((double)count));
+    uint32_t rows = (count + columns - 1) / std::max<uint32_t>(columns, 1);
+    std::vector<EdgePartition::Edge> sites;
+    for(uint32_t idx = 0; idx < count; idx++) {
+        location_t x = (location_t)(side * (idx % columns + 0.5) / columns);
+        location_t y = (location_t)(side * (idx / columns + 0.5) / rows);
+        sites.push_back(EdgePartition::Edge{firstId + idx, x, y});
+    }
+    return sites;
+}
+
+// takes the last edge out of the partition. every edge and peer moves to the new one, and the
+// retired edge hands what it owned to the edges whose regions grow to take it in
+void RetireEdge(std::shared_ptr<const ElementCatalog> catalog, std::shared_ptr<const EdgePartition> current,
+                std::vector<Ptr<EdgeServerApplication>> edges, std::vector<Ptr<EdgeAwareClientApplication>> clients) {
+    std::vector<EdgePartition::Edge> sites;
+    for(size_t idx = 0; idx + 1 < current->size(); idx++) {
+        sites.push_back(current->get_edge(idx));
+    }
+    auto next = std::make_shared<const EdgePartition>(*catalog, sites, current->get_epoch() + 1);
+    NS_LOG_INFO("Retiring edge " << current->get_edge(current->size() - 1).id << " at " << Simulator::Now().GetSeconds() << "s");
+    for(Ptr<EdgeServerApplication> edge : edges) {
+        edge->Repartition(next);
+    }
+    for(Ptr<EdgeAwareClientApplication> client : clients) {
+        client->SetEdgePartition(next);
+    }
+}
+
 int main(int argc, char *argv[]) {
     LogComponentEnable("Peers", LOG_LEVEL_INFO);
-    // CommandLine cmd;
-    // cmd.Parse(argc, argv);
-    const static int num_nodes = 3;
+    // pushing new states to neighbors is off unless a fanout is given
+    uint32_t pushFanout = 0;
+    // the data radio wakes for dataWindow ms out of every dataPeriod ms; a period of 0 keeps it on
+    uint32_t dataPeriod = 500;
+    uint32_t dataWindow = 50;
+    CommandLine cmd;
+    cmd.AddValue("pushFanout", "neighbors each new element state is pushed to, 0 for pull only", pushFanout);
+    cmd.AddValue("dataPeriod", "milliseconds between data radio wake-ups, 0 to keep it on", dataPeriod);
+    cmd.AddValue("dataWindow", "milliseconds the data radio stays awake each period", dataWindow);
+    // node 0 writes feature data of this size to the elements it is near, 0 for metadata only
+    uint32_t payloadBytes = 0;
+    cmd.AddValue("payloadBytes", "bytes of feature data node 0 writes to each element it is near, 0 for none", payloadBytes);
+    // churn: every node alternates sessions and downtimes of these mean lengths; a session mean of 0 keeps nodes up
+    double duration = 13;
+    double sessionMean = 0;
+    double downtimeMean = 5;
+    std::string sessionDistribution = "exponential";
+    std::string downtimeDistribution = "exponential";
+    bool coldRejoin = false;
+    cmd.AddValue("duration", "simulated seconds the nodes run for", duration);
+    cmd.AddValue("sessionMean", "mean seconds a node stays up between downtimes, 0 for no churn", sessionMean);
+    cmd.AddValue("downtimeMean", "mean seconds a node stays down", downtimeMean);
+    cmd.AddValue("sessionDistribution", "exponential, pareto, uniform or constant", sessionDistribution);
+    cmd.AddValue("downtimeDistribution", "exponential, pareto, uniform or constant", downtimeDistribution);
+    cmd.AddValue("coldRejoin", "returning nodes start over instead of keeping their state", coldRejoin);
+    // a run can save its steady state, and later runs can start from it instead of bootstrapping
+    std::string snapshotFile = "edge-aware.snapshot";
+    double snapshotAt = 0;
+    std::string warmStart = "";
+    cmd.AddValue("snapshotFile", "where --snapshotAt saves the snapshot", snapshotFile);
+    cmd.AddValue("snapshotAt", "simulated second to save a snapshot of every node at, 0 for never", snapshotAt);
+    cmd.AddValue("warmStart", "snapshot to load every node's state and position from", warmStart);
+    // edge servers, each owning the elements in its region of the area; see EdgeServerApplication
+    uint32_t edges = 0;
+    double retireEdgeAt = 0;
+    cmd.AddValue("edges", "edge servers spread over the area, 0 for peers only", edges);
+    cmd.AddValue("retireEdgeAt", "simulated second the last edge retires and hands its elements off, 0 for never", retireEdgeAt);
+    // the size of the scenario: peers placed at random on an areaSide x areaSide square, and either
+    // the five elements below or this many spread at random over the same square
+    uint32_t num_nodes = 3;
+    uint32_t elements = 0;
+    double areaSide = 10;
+    bool pcap = true;
+    cmd.AddValue("nodes", "peers in the simulation", num_nodes);
+    cmd.AddValue("elements", "elements placed at random over the area, 0 for the five built in", elements);
+    cmd.AddValue("areaSide", "side in meters of the square the peers and elements are placed on", areaSide);
+    cmd.AddValue("pcap", "write a capture of every radio", pcap);
+    cmd.Parse(argc, argv);
+
+    Snapshot snapshot;
+    if(!warmStart.empty()) {
+        snapshot = ReadSnapshot(warmStart);
+        if(snapshot.states.size() != num_nodes) {
+            NS_FATAL_ERROR("snapshot " << warmStart << " has " << snapshot.states.size() << " nodes, not " << num_nodes);
+        }
+    }
+    // peers and edges share the beacon and data subnets, and element ids are 16 bit
+    if(num_nodes == 0 || (uint64_t)num_nodes + edges > MaxHostsPerSubnet) {
+        NS_FATAL_ERROR("--nodes plus --edges must be between 1 and " << MaxHostsPerSubnet << ", the hosts one subnet holds");
+    }
+    if(elements > (uint32_t)std::numeric_limits<elementId_t>::max() + 1) {
+        NS_FATAL_ERROR("--elements can be at most " << (uint32_t)std::numeric_limits<elementId_t>::max() + 1 << " since element ids are 16 bit");
+    }
+    if(retireEdgeAt > 0 && edges < 2) {
+        NS_FATAL_ERROR("--retireEdgeAt needs at least two edges, one to retire and one to take over");
+    }
     NodeContainer nodes;
     nodes.Create(num_nodes); 
+    // created after the peers, so the peers keep node ids 0 to num_nodes - 1
+    NodeContainer edgeNodes;
+    edgeNodes.Create(edges);
    
-    WifiHelper wifi;
-    wifi.SetStandard(WIFI_STANDARD_80211b);
-    std::string phyMode("DsssRate1Mbps");
-    Config::SetDefault("ns3::WifiRemoteStationManager::NonUnicastMode", StringValue(phyMode));
-
-    YansWifiPhyHelper wifiPhy;
-    // This is one parameter that matters when using FixedRssLossModel
-    // set it to zero; otherwise, gain will be added
-    wifiPhy.Set("RxGain", DoubleValue(0));
-    // ns-3 supports RadioTap and Prism tracing extensions for 802.11b
-    wifiPhy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
-  
-    YansWifiChannelHelper wifiChannel;
-    wifiChannel.SetPropagationDelay("ns3::ConstantSpeedPropagationDelayModel");
-    // The below FixedRssLossModel will cause the rss to be fixed regardless
-    // of the distance between the two stations, and the transmit power
-    wifiChannel.AddPropagationLoss("ns3::LogDistancePropagationLossModel");
-    wifiPhy.SetChannel(wifiChannel.Create());
-  
-    // Add a mac and disable rate control
-    WifiMacHelper wifiMac;
-    wifi.SetRemoteStationManager("ns3::ConstantRateWifiManager",
+    // the beacon radio: 1 Mbps, low power, and nothing gets through past 10 m
+    WifiHelper beaconWifi;
+    beaconWifi.SetStandard(WIFI_STANDARD_80211b);
+    std::string beaconMode("DsssRate1Mbps");
+    beaconWifi.SetRemoteStationManager("ns3::ConstantRateWifiManager",
+                                   "DataMode",
+                                   StringValue(beaconMode),
+                                   "ControlMode",
+                                   StringValue(beaconMode));
+    YansWifiPhyHelper beaconPhy;
+    beaconPhy.Set("RxGain", DoubleValue(0));
+    beaconPhy.Set("TxPowerStart", DoubleValue(0));
+    beaconPhy.Set("TxPowerEnd", DoubleValue(0));
+    beaconPhy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
+    YansWifiChannelHelper beaconChannel;
+    beaconChannel.SetPropagationDelay("ns3::ConstantSpeedPropagationDelayModel");
+    beaconChannel.AddPropagationLoss("ns3::RangePropagationLossModel", "MaxRange", DoubleValue(10.0));
+    beaconPhy.SetChannel(beaconChannel.Create());
+
+    // the data radio: 11 Mbps at full power on its own channel, with ordinary log distance loss
+    WifiHelper dataWifi;
+    dataWifi.SetStandard(WIFI_STANDARD_80211b);
+    std::string dataMode("DsssRate11Mbps");
+    dataWifi.SetRemoteStationManager("ns3::ConstantRateWifiManager",
                                    "DataMode",
-                                   StringValue(phyMode),
+                                   StringValue(dataMode),
                                    "ControlMode",
-                                   StringValue(phyMode));
-    // Set it to adhoc mode
+                                   StringValue(dataMode));
+    YansWifiPhyHelper dataPhy;
+    dataPhy.Set("RxGain", DoubleValue(0));
+    dataPhy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
+    YansWifiChannelHelper dataChannel;
+    dataChannel.SetPropagationDelay("ns3::ConstantSpeedPropagationDelayModel");
+    dataChannel.AddPropagationLoss("ns3::LogDistancePropagationLossModel");
+    dataPhy.SetChannel(dataChannel.Create());
+
+    // both are ad-hoc; the beacon radio is installed first so it gets the lower interface index
+    WifiMacHelper wifiMac;
     wifiMac.SetType("ns3::AdhocWifiMac");
-    NetDeviceContainer devices = wifi.Install(wifiPhy, wifiMac, nodes);
-/*
-    PointToPointHelper p2p;
-    p2p.SetDeviceAttribute("DataRate", StringValue("10Mbps"));
-    p2p.SetChannelAttribute("Delay", StringValue("2ms"));
-
-    NetDeviceContainer devices;
-    devices = p2p.Install(nodes);
-    NS_LOG_INFO("Testing");
-*/
+    NetDeviceContainer beaconDevices = beaconWifi.Install(beaconPhy, wifiMac, nodes);
+    NetDeviceContainer dataDevices = dataWifi.Install(dataPhy, wifiMac, nodes);
+    NetDeviceContainer edgeBeaconDevices = beaconWifi.Install(beaconPhy, wifiMac, edgeNodes);
+    NetDeviceContainer edgeDataDevices = dataWifi.Install(dataPhy, wifiMac, edgeNodes);
+
+    // the edges' backhaul: a gigabit LAN between all of them
+    CsmaHelper backhaulLan;
+    backhaulLan.SetChannelAttribute("DataRate", StringValue("1Gbps"));
+    backhaulLan.SetChannelAttribute("Delay", TimeValue(MicroSeconds(100)));
+    NetDeviceContainer backhaulDevices = backhaulLan.Install(edgeNodes);
+
+    // each radio runs off its own battery so their use can be told apart. the currents are rough
+    // figures for a BLE chip and for a cellular modem, drawn at 3 V. edges are plugged in
+    BasicEnergySourceHelper batteryHelper;
+    batteryHelper.Set("BasicEnergySourceInitialEnergyJ", DoubleValue(10000));
+    batteryHelper.Set("BasicEnergySupplyVoltageV", DoubleValue(3.0));
+    EnergySourceContainer beaconBatteries = batteryHelper.Install(nodes);
+    EnergySourceContainer dataBatteries = batteryHelper.Install(nodes);
+
+    WifiRadioEnergyModelHelper beaconEnergy;
+    beaconEnergy.Set("TxCurrentA", DoubleValue(0.008));
+    beaconEnergy.Set("RxCurrentA", DoubleValue(0.006));
+    beaconEnergy.Set("IdleCurrentA", DoubleValue(0.001));
+    beaconEnergy.Set("CcaBusyCurrentA", DoubleValue(0.001));
+    beaconEnergy.Set("SleepCurrentA", DoubleValue(0.000001));
+    DeviceEnergyModelContainer beaconRadios = beaconEnergy.Install(beaconDevices, beaconBatteries);
+
+    WifiRadioEnergyModelHelper dataEnergy;
+    dataEnergy.Set("TxCurrentA", DoubleValue(0.6));
+    dataEnergy.Set("RxCurrentA", DoubleValue(0.3));
+    dataEnergy.Set("IdleCurrentA", DoubleValue(0.2));
+    dataEnergy.Set("CcaBusyCurrentA", DoubleValue(0.2));
+    dataEnergy.Set("SleepCurrentA", DoubleValue(0.001));
+    DeviceEnergyModelContainer dataRadios = dataEnergy.Install(dataDevices, dataBatteries);
+
     InternetStackHelper stack;
     stack.Install(nodes);
+    stack.Install(edgeNodes);
  
-    // IP address assignment to the above interface
+    // IP address assignment to the above interface. interfaces are numbered in the order they are
+    // assigned, so an edge gets beacon, data and then backhaul
     Ipv4AddressHelper address;
-    address.SetBase("10.1.1.0", "255.255.255.0"); 
-    Ipv4InterfaceContainer interfaces = address.Assign(devices);
-
-    // Temporary way to do it but we can do a loop for each node or we can write a helper
-    Ptr<EdgeAwareClientApplication> ClientApps[num_nodes];
-    Ptr<Socket> UdpDataSendSockets[num_nodes];
-    Ptr<Socket> UdpDataRecvSockets[num_nodes];
-    Ptr<Socket> UdpBeaconSinks[num_nodes];
-    Ptr<Socket> UdpBeaconSources[num_nodes];
+    address.SetBase(BeaconSubnet, SubnetMask);
+    address.Assign(beaconDevices);
+    address.Assign(edgeBeaconDevices);
+    address.SetBase(DataSubnet, SubnetMask);
+    Ipv4InterfaceContainer dataInterfaces = address.Assign(dataDevices);
+    Ipv4InterfaceContainer edgeDataInterfaces = address.Assign(edgeDataDevices);
+    address.SetBase(BackhaulSubnet, SubnetMask);
+    Ipv4InterfaceContainer backhaulInterfaces = address.Assign(backhaulDevices);
+
+    std::vector<Ptr<EdgeAwareClientApplication>> ClientApps(num_nodes);
+    std::vector<Ptr<Socket>> UdpDataSendSockets(num_nodes);
+    std::vector<Ptr<Socket>> UdpDataRecvSockets(num_nodes);
+    std::vector<Ptr<Socket>> UdpBeaconSinks(num_nodes);
+    std::vector<Ptr<Socket>> UdpBeaconSources(num_nodes);
 
     TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
 
-    for (int n = 0; n < num_nodes; n++) {
+    // one read-only element table for the whole simulation
+    std::vector<std::pair<location_t, location_t>> baseElementLocations{
+        {2.5f, 5.5f},
+        {1.0f, 4.0f},
+        {3.0f, 6.5f},
+        {5.0f, 9.0f},
+        {6.0f, 2.5f}
+    };
+    if(elements > 0) {
+        auto element_rv = CreateObject<UniformRandomVariable>();
+        element_rv->SetAttribute("Min", DoubleValue(0));
+        element_rv->SetAttribute("Max", DoubleValue(areaSide));
+        baseElementLocations.clear();
+        for(uint32_t e = 0; e < elements; e++) {
+            location_t x = (location_t)element_rv->GetValue();
+            baseElementLocations.emplace_back(x, (location_t)element_rv->GetValue());
+        }
+    }
+    auto catalog = std::make_shared<const ElementCatalog>(baseElementLocations, 8.0f);
+    // and one partition of it among the edges, over the same area the peers are placed in
+    auto partition = std::make_shared<const EdgePartition>(*catalog, EdgeSites(edges, num_nodes, areaSide), 1);
+
+    for (uint32_t n = 0; n < num_nodes; n++) {
         // each client needs an application
         ClientApps[n] = CreateObject<EdgeAwareClientApplication>();
 
         UdpDataRecvSockets[n] = Socket::CreateSocket(nodes.Get(n), tid);
-        UdpDataRecvSockets[n]->Bind(InetSocketAddress(interfaces.GetAddress(n), 8080));
+        UdpDataRecvSockets[n]->Bind(InetSocketAddress(dataInterfaces.GetAddress(n), 8080));
 
         // beacon_sink on every node
         UdpBeaconSinks[n] = Socket::CreateSocket(nodes.Get(n), tid);
         UdpBeaconSinks[n]->Bind(InetSocketAddress(Ipv4Address::GetAny(), 80));
 
         UdpDataSendSockets[n] = Socket::CreateSocket(nodes.Get(n), tid);
+        UdpDataSendSockets[n]->BindToNetDevice(dataDevices.Get(n));
 
         // beacon source on every node
         UdpBeaconSources[n] = Socket::CreateSocket(nodes.Get(n), tid);
         UdpBeaconSources[n]->SetAllowBroadcast(true);
+        UdpBeaconSources[n]->BindToNetDevice(beaconDevices.Get(n));
         UdpBeaconSources[n]->Connect(BeaconBroadcastAddress);        
 
-        ClientApps[n]->Setup(UdpDataSendSockets[n], UdpDataRecvSockets[n], UdpBeaconSources[n], UdpBeaconSinks[n]);
+        ClientApps[n]->Setup(UdpDataSendSockets[n], UdpDataRecvSockets[n], UdpBeaconSources[n], UdpBeaconSinks[n], catalog, pushFanout, dataPeriod, dataWindow);
         auto unif_rv = CreateObject<UniformRandomVariable>();
         unif_rv->SetAttribute("Min", DoubleValue(0));
         unif_rv->SetAttribute("Max", DoubleValue(1));
+        if(!warmStart.empty()) {
+            ClientApps[n]->WarmStart(snapshot.states[n]);
+        }
+        if(n == 0) {
+            ClientApps[n]->SetPayloadBytes(payloadBytes);
+        }
+        ClientApps[n]->SetEdgePartition(partition);
+        if(sessionMean > 0) {
+            ClientApps[n]->SetChurn(ChurnDistribution(sessionDistribution, sessionMean), ChurnDistribution(downtimeDistribution, downtimeMean), coldRejoin);
+        }
         ClientApps[n]->SetStartTime(Seconds(unif_rv->GetValue()));
-        ClientApps[n]->SetStopTime(Seconds(13.0));
+        ClientApps[n]->SetStopTime(Seconds(duration));
         
         nodes.Get(n)->AddApplication(ClientApps[n]);
     }
 
+    std::vector<Ptr<EdgeServerApplication>> EdgeApps;
+    std::map<nodeId_t, uint32_t> backhaul;
+    for(uint32_t n = 0; n < edges; n++) {
+        backhaul[edgeNodes.Get(n)->GetId()] = backhaulInterfaces.GetAddress(n).Get();
+    }
+    for(uint32_t n = 0; n < edges; n++) {
+        Ptr<Node> node = edgeNodes.Get(n);
+        Ptr<Socket> dataRecv = Socket::CreateSocket(node, tid);
+        dataRecv->Bind(InetSocketAddress(edgeDataInterfaces.GetAddress(n), 8080));
+        Ptr<Socket> beaconSink = Socket::CreateSocket(node, tid);
+        beaconSink->Bind(InetSocketAddress(Ipv4Address::GetAny(), 80));
+        Ptr<Socket> dataSend = Socket::CreateSocket(node, tid);
+        dataSend->BindToNetDevice(edgeDataDevices.Get(n));
+        Ptr<Socket> beaconSource = Socket::CreateSocket(node, tid);
+        beaconSource->SetAllowBroadcast(true);
+        beaconSource->BindToNetDevice(edgeBeaconDevices.Get(n));
+        beaconSource->Connect(BeaconBroadcastAddress);
+        Ptr<Socket> backhaulSocket = Socket::CreateSocket(node, tid);
+        backhaulSocket->Bind(InetSocketAddress(backhaulInterfaces.GetAddress(n), 8080));
+
+        Ptr<EdgeServerApplication> app = CreateObject<EdgeServerApplication>();
+        app->Setup(dataSend, dataRecv, beaconSource, beaconSink, backhaulSocket, catalog, partition, pushFanout);
+        app->SetBackhaul(backhaul);
+        app->SetStartTime(Seconds(0));
+        app->SetStopTime(Seconds(duration));
+        node->AddApplication(app);
+        EdgeApps.push_back(app);
+    }
+    if(retireEdgeAt > 0) {
+        Simulator::Schedule(Seconds(retireEdgeAt), &RetireEdge, catalog, partition, EdgeApps, ClientApps);
+    }
+
     // change the velocity and model:
     // Ptr<ConstantVelocityMobilityModel> nodeMobilityModel = nodes.Get(0)->GetObject<ConstantVelocityMobilityModel>();
     // nodeMobilityModel->SetVelocity(Vector(speed, 0, 0));
@@ -755,33 +983,112 @@ int main(int argc, char *argv[]) {
     // nodeMobilityModel2->SetVelocity(Vector(-speed, 0, 0));
     
     MobilityHelper mobility;
-    auto positions = CreateObject<RandomRectanglePositionAllocator>();
+    if(warmStart.empty()) {
+        auto positions = CreateObject<RandomRectanglePositionAllocator>();
   
-    // change this seed when necessary 
-    RngSeedManager::SetSeed(1); 
-    auto unif_rv = CreateObject<UniformRandomVariable>();
-    unif_rv->SetAttribute("Min", DoubleValue(0));
-    unif_rv->SetAttribute("Max", DoubleValue(10));
+        // change this seed when necessary 
+        RngSeedManager::SetSeed(1); 
+        auto unif_rv = CreateObject<UniformRandomVariable>();
+        unif_rv->SetAttribute("Min", DoubleValue(0));
+        unif_rv->SetAttribute("Max", DoubleValue(areaSide));
 
-    positions->SetX(unif_rv);
-    positions->SetY(unif_rv);
+        positions->SetX(unif_rv);
+        positions->SetY(unif_rv);
 
-    mobility.SetPositionAllocator(positions);
+        mobility.SetPositionAllocator(positions);
+    }
+    else {
+        // carry on with the snapshot's random streams and positions. ns-3 cannot restore a stream
+        // partway through, so this replays the seed and run the snapshot was taken with
+        RngSeedManager::SetSeed(snapshot.seed);
+        RngSeedManager::SetRun(snapshot.run);
+        auto positions = CreateObject<ListPositionAllocator>();
+        for(const Vector &position : snapshot.positions) {
+            positions->Add(position);
+        }
+        mobility.SetPositionAllocator(positions);
+    }
 
     mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
     mobility.Install(nodes);
+
+    // edges stand at their sites
+    MobilityHelper edgeMobility;
+    auto edgePositions = CreateObject<ListPositionAllocator>();
+    for(size_t idx = 0; idx < partition->size(); idx++) {
+        edgePositions->Add(Vector(partition->get_edge(idx).x, partition->get_edge(idx).y, 0));
+    }
+    edgeMobility.SetPositionAllocator(edgePositions);
+    edgeMobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    edgeMobility.Install(edgeNodes);
     
     // simulator now ends late so that the applications can dump state
-    Simulator::Stop(Seconds(14.0));
+    Simulator::Stop(Seconds(duration + 1));
+    if(snapshotAt > 0) {
+        Simulator::Schedule(Seconds(snapshotAt), &WriteSnapshot, snapshotFile, nodes, ClientApps);
+    }
     
     // Enable global static routing
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
     // p2p.EnablePcapAll("peer-to-peer"); 
-    wifiPhy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
-    wifiPhy.EnablePcap("edge-aware", devices);
+    if(pcap) {
+        beaconPhy.EnablePcap("edge-aware-beacon", beaconDevices);
+        dataPhy.EnablePcap("edge-aware", dataDevices);
+    }
 
-    // Run simulation
+    // Run simulation. the wall time covers ns-3 and the wifi model as well as the protocol, which
+    // is what scale_bench.cpp leaves out
+    auto wallBegin = std::chrono::steady_clock::now();
     Simulator::Run();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallBegin).count();
+
+    // the energy models are still around until Destroy
+    double beaconJoules = 0, dataJoules = 0;
+    uint32_t wakeups = 0;
+    std::vector<const PeerProtocol*> peers;
+    std::vector<std::pair<int64_t, uint64_t>> recoveries;
+    uint32_t unrecovered = 0;
+    for (uint32_t n = 0; n < num_nodes; n++) {
+        beaconJoules += beaconRadios.Get(n)->GetTotalEnergyConsumption();
+        dataJoules += dataRadios.Get(n)->GetTotalEnergyConsumption();
+        wakeups += ClientApps[n]->get_dataWakeups();
+        peers.push_back(&ClientApps[n]->get_protocol());
+        recoveries.insert(recoveries.end(), ClientApps[n]->get_recoveries().begin(), ClientApps[n]->get_recoveries().end());
+        unrecovered += ClientApps[n]->get_unrecovered();
+    }
+    if(sessionMean > 0) {
+        int64_t totalMs = 0, maxMs = 0;
+        uint64_t totalBytes = 0;
+        for(const auto &r : recoveries) {
+            totalMs += r.first;
+            maxMs = std::max(maxMs, r.first);
+            totalBytes += r.second;
+        }
+        size_t count = std::max<size_t>(recoveries.size(), 1);
+        NS_LOG_INFO((coldRejoin ? "Cold" : "Fast") << " rejoins caught up: " << recoveries.size() << ", went down first: " << unrecovered
+            << ", mean recovery: " << totalMs / (int64_t)count << " ms (max " << maxMs << " ms), mean bytes per rejoin: " << totalBytes / count);
+    }
+    // what each edge carried, to check that it follows the size of its region
+    uint64_t maxEdgeBytes = 0;
+    size_t maxEdgeStates = 0;
+    for(Ptr<EdgeServerApplication> edge : EdgeApps) {
+        const PeerProtocol &protocol = edge->get_protocol();
+        NS_LOG_INFO("Edge " << protocol.get_nodeId() << ": owns " << edge->get_owned().size() << " elements, holds "
+            << protocol.get_AgreementInformation().size() << " states and " << protocol.get_chunkStore().bytes() << " payload bytes, "
+            << edge->get_messagesIn() << " messages (" << edge->get_bytesIn() << " bytes) in, " << edge->get_bytesOut() << " bytes out, "
+            << edge->get_handedOff() << " elements handed off");
+        maxEdgeBytes = std::max(maxEdgeBytes, edge->get_bytesIn() + edge->get_bytesOut());
+        maxEdgeStates = std::max(maxEdgeStates, protocol.get_AgreementInformation().size());
+    }
+    if(!EdgeApps.empty()) {
+        NS_LOG_INFO("Busiest edge: " << maxEdgeBytes << " bytes in and out, largest edge: " << maxEdgeStates << " states");
+    }
+    size_t converged = CountConvergedElements(peers);
+    NS_LOG_INFO("Beacon radios: " << beaconJoules << " J, data radios: " << dataJoules << " J, data radio wake-ups: " << wakeups);
+    NS_LOG_INFO("Simulated " << num_nodes << " peers and " << catalog->size() << " elements on a " << areaSide << " m square in "
+        << wall << " s of wall time, " << Simulator::GetEventCount() / std::max(wall, 1e-9) << " events/s");
+    NS_LOG_INFO("Converged elements: " << converged << ", J per converged element: "
+        << (converged == 0 ? 0.0 : (beaconJoules + dataJoules) / converged));
     Simulator::Destroy();
 
     return 0;
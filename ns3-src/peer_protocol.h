@@ -0,0 +1,2626 @@
+#ifndef PEER_PROTOCOL_H
+#define PEER_PROTOCOL_H
+
+// the wire format, the per-element agreement state and the agreement rules for the peer nodes.
+// nothing in here depends on ns-3, so the same code runs inside the simulation (peer_node.cpp)
+// and inside standalone drivers like alloc_count.cpp.
+//
+// peer_node.cpp points PEER_LOG at NS_LOG_INFO before including this header
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "sha256.h"
+
+#ifndef PEER_LOG
+#define PEER_LOG(msg)
+#endif
+
+typedef enum : uint8_t {
+    ADVERT,
+    REQUEST_DATA,
+    SEND_DATA,
+    ACK,
+    ADVERT_PART,
+    SEND_DATA_CHUNK,
+    CHUNK_ACK,
+    REQUEST_CHUNKS,
+    SEND_CHUNK,
+    SYNC_DIGEST,
+    SYNC_DATA,
+    SYNC_ACK,
+
+} MessageType;
+
+// element ids are 16 bit so that a catalog can hold tens of thousands of elements
+typedef uint16_t elementId_t;
+typedef uint8_t causalNum_t;
+typedef uint32_t nodeId_t;
+typedef float location_t;
+// payload chunks are named by a digest of their bytes, see ChunkStore
+typedef uint64_t chunkHash_t;
+
+// undoing transformation, so endianness should not matter
+inline void fourByteToOne(uint32_t c, std::vector<uint8_t> *mesg) {
+    mesg->push_back((c) & 0xFF);
+    mesg->push_back((c >> 8) & 0xFF);
+    mesg->push_back((c >> 16) & 0xFF);
+    mesg->push_back((c >> 24) & 0xFF);
+}
+
+inline void twoByteToOne(uint16_t c, std::vector<uint8_t> *mesg) {
+    mesg->push_back((c) & 0xFF);
+    mesg->push_back((c >> 8) & 0xFF);
+}
+
+inline uint16_t oneByteToTwo(const uint8_t *c) {
+    return (uint16_t)(c[0]) | (uint16_t)((uint16_t)(c[1]) << 8);
+}
+
+inline uint32_t oneByteToFour(const uint8_t *c) {
+    uint32_t r = 0;
+    r += (uint32_t)(c[0]);
+    r += (uint32_t)(c[1]) << 8;
+    r += (uint32_t)(c[2]) << 16;
+    r += (uint32_t)(c[3]) << 24;
+    return r;
+}
+
+inline void eightByteToOne(uint64_t c, std::vector<uint8_t> *mesg) {
+    fourByteToOne((uint32_t)c, mesg);
+    fourByteToOne((uint32_t)(c >> 32), mesg);
+}
+
+inline uint64_t oneByteToEight(const uint8_t *c) {
+    return (uint64_t)oneByteToFour(c) | ((uint64_t)oneByteToFour(c + 4) << 32);
+}
+
+// read-only view over the sync group members inside a received SEND_DATA: a 32 bit node id
+// followed by how many epochs ago the sender last confirmed that node
+class PackedMembers {
+public:
+    static const size_t memberSize = 5;
+
+    PackedMembers(): data(nullptr), count(0) {}
+    PackedMembers(const uint8_t *d, size_t n): data(d), count(n) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    nodeId_t id(size_t idx) const { return oneByteToFour(data + memberSize*idx); }
+    uint8_t age(size_t idx) const { return data[memberSize*idx + 4]; }
+
+    bool contains(nodeId_t n) const {
+        for(size_t idx = 0; idx < count; idx++) {
+            if(id(idx) == n) {
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    const uint8_t *data;
+    size_t count;
+};
+
+// read-only view over the payload chunk hashes inside a received SEND_DATA or REQUEST_CHUNKS
+class PackedHashes {
+public:
+    static const size_t hashSize = 8;
+
+    PackedHashes(): data(nullptr), count(0) {}
+    PackedHashes(const uint8_t *d, size_t n): data(d), count(n) {}
+
+    size_t size() const { return count; }
+    chunkHash_t hash(size_t idx) const { return oneByteToEight(data + hashSize*idx); }
+private:
+    const uint8_t *data;
+    size_t count;
+};
+
+// the synchronized set for one element, limited to the nodes confirmed within the last
+// horizon epochs. members live in one bucket per epoch; when time moves past a bucket's epoch
+// by more than the horizon the whole bucket is emptied and reused for the new epoch, so memory
+// stays bounded by the nodes actually active in the window no matter how many have come and gone.
+// every node is in at most one bucket, the one for the epoch it was last confirmed in
+class SyncGroup {
+public:
+    explicit SyncGroup(uint32_t horizon = 6): buckets(std::max<uint32_t>(horizon, 1)), headEpoch(0), head(0) {}
+
+    uint32_t horizon() const { return buckets.size(); }
+    // the newest epoch the group has been moved to
+    uint32_t latest() const { return headEpoch; }
+
+    // moves the window forward to epoch, emptying buckets that fall out of it
+    void Advance(uint32_t epoch) {
+        if(epoch <= headEpoch) {
+            return;
+        }
+        uint32_t steps = std::min<uint32_t>(epoch - headEpoch, buckets.size());
+        for(uint32_t i = 0; i < steps; i++) {
+            head = (head + 1) % buckets.size();
+            buckets[head].clear();
+        }
+        headEpoch = epoch;
+    }
+
+    bool contains(nodeId_t n, uint32_t epoch) const {
+        return AgeOf(n, epoch) < horizon();
+    }
+
+    // confirms n as of epoch. returns true if n was not a member of the window before
+    bool add(nodeId_t n, uint32_t epoch) {
+        Advance(epoch);
+        bool fresh = !Remove(n);
+        Insert(buckets[head], n);
+        return fresh;
+    }
+
+    // confirms n as of epoch only if it is already a member
+    void refresh(nodeId_t n, uint32_t epoch) {
+        Advance(epoch);
+        if(Remove(n)) {
+            Insert(buckets[head], n);
+        }
+    }
+
+    // replaces the group with members received from a peer, keeping their ages
+    void assign(const PackedMembers &members, uint32_t epoch) {
+        Advance(epoch);
+        for(std::vector<nodeId_t> &bucket : buckets) {
+            bucket.clear();
+        }
+        for(size_t idx = 0; idx < members.size(); idx++) {
+            if(members.age(idx) < horizon()) {
+                buckets[(head + buckets.size() - members.age(idx)) % buckets.size()].push_back(members.id(idx));
+            }
+        }
+        for(std::vector<nodeId_t> &bucket : buckets) {
+            std::sort(bucket.begin(), bucket.end());
+            bucket.erase(std::unique(bucket.begin(), bucket.end()), bucket.end());
+        }
+    }
+
+    // calls f(node, age) for every member still inside the window as of epoch, newest first
+    template<typename F>
+    void forEach(uint32_t epoch, F f) const {
+        uint32_t lag = epoch > headEpoch ? epoch - headEpoch : 0;
+        for(uint32_t i = 0; i + lag < horizon(); i++) {
+            for(nodeId_t n : buckets[(head + buckets.size() - i) % buckets.size()]) {
+                f(n, (uint8_t)(i + lag));
+            }
+        }
+    }
+
+    size_t size(uint32_t epoch) const {
+        size_t total = 0;
+        forEach(epoch, [&total](nodeId_t, uint8_t) { total++; });
+        return total;
+    }
+
+private:
+    // how many epochs ago n was confirmed, or horizon() if it is not a member
+    uint32_t AgeOf(nodeId_t n, uint32_t epoch) const {
+        uint32_t lag = epoch > headEpoch ? epoch - headEpoch : 0;
+        for(uint32_t i = 0; i + lag < horizon(); i++) {
+            const std::vector<nodeId_t> &bucket = buckets[(head + buckets.size() - i) % buckets.size()];
+            if(std::binary_search(bucket.begin(), bucket.end(), n)) {
+                return i + lag;
+            }
+        }
+        return horizon();
+    }
+
+    bool Remove(nodeId_t n) {
+        for(std::vector<nodeId_t> &bucket : buckets) {
+            auto it = std::lower_bound(bucket.begin(), bucket.end(), n);
+            if(it != bucket.end() && *it == n) {
+                bucket.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void Insert(std::vector<nodeId_t> &bucket, nodeId_t n) {
+        bucket.insert(std::lower_bound(bucket.begin(), bucket.end(), n), n);
+    }
+
+    // buckets[head] is headEpoch, buckets[head - i] is headEpoch - i
+    std::vector<std::vector<nodeId_t>> buckets;
+    uint32_t headEpoch;
+    uint32_t head;
+};
+
+// EVAN Addition >>>
+class AgreementInformation {
+public:
+    AgreementInformation(const std::pair<location_t, location_t> &cl, nodeId_t id, uint32_t epoch, uint32_t horizon): versionNumber(0), roundNumber(0), fineLocation(cl), agreeingNodes(horizon) {
+        agreeingNodes.add(id, epoch);
+    }
+
+    void set_version(causalNum_t v) { versionNumber = v; }
+    causalNum_t get_version() const { return versionNumber; }
+
+    void set_round(causalNum_t r) { roundNumber = r; }
+    causalNum_t get_round() const { return roundNumber; }
+
+    void set_fineLocation(location_t x, location_t y) {
+        fineLocation.first = x;
+        fineLocation.second = y;
+    }
+    const std::pair<location_t, location_t>& get_fineLocation() const { return fineLocation; }
+
+    // the feature's data, as the hashes of its chunks in order. the chunks themselves are in the
+    // node's ChunkStore, or still missing from it
+    void set_payload(const std::vector<chunkHash_t> &p) { payload = p; }
+    void set_payload(const PackedHashes &p) {
+        payload.resize(p.size());
+        for(size_t idx = 0; idx < p.size(); idx++) {
+            payload[idx] = p.hash(idx);
+        }
+    }
+    const std::vector<chunkHash_t>& get_payload() const { return payload; }
+
+    // the synchronized set only covers the nodes confirmed within the sync horizon, see SyncGroup
+    bool add_agreeingNodes(nodeId_t n, uint32_t epoch) { return agreeingNodes.add(n, epoch); }
+    void refresh_agreeingNodes(nodeId_t n, uint32_t epoch) { agreeingNodes.refresh(n, epoch); }
+    void set_agreeingNodes(const PackedMembers &members, uint32_t epoch) { agreeingNodes.assign(members, epoch); }
+    bool count_agreeingNodes(nodeId_t n, uint32_t epoch) const { return agreeingNodes.contains(n, epoch); }
+    const SyncGroup& get_agreeingNodes() const { return agreeingNodes; }
+
+    friend std::ostream& operator<< (std::ostream &os, const AgreementInformation &a) {
+        os << "Version: " << unsigned(a.versionNumber) << "\nRound: " << unsigned(a.roundNumber)  << std::endl;
+        os << "Location: (" << a.fineLocation.first << ", " << a.fineLocation.second << ")\n";
+        os << "Synchronized Nodes: ";
+        a.agreeingNodes.forEach(a.agreeingNodes.latest(), [&os](nodeId_t elem, uint8_t) {
+            os << elem << " ";
+        });
+
+        return os;
+    }
+private:
+    causalNum_t versionNumber, roundNumber;
+    // no coarse location, as our system uses the same data type for both fine and coarse locations
+    std::pair<location_t, location_t> fineLocation;
+    SyncGroup agreeingNodes;
+    std::vector<chunkHash_t> payload;
+};
+
+// the ids and base locations of every element in the simulation. there is one of these shared
+// by all nodes and it never changes after construction, so nodes only pay for the elements they
+// have actually come near. a uniform grid over the base locations answers "what is near me"
+// without touching every element
+class ElementCatalog {
+public:
+    ElementCatalog(const std::vector<std::pair<location_t, location_t>> &locations, location_t cellSize_):
+        baseLocations(locations), cellSize(cellSize_)
+    {
+        cells.reserve(baseLocations.size());
+        for(size_t idx = 0; idx < baseLocations.size(); idx++) {
+            cells.push_back(std::pair<uint64_t, elementId_t>(CellKey(CellOf(baseLocations[idx].first), CellOf(baseLocations[idx].second)), (elementId_t)idx));
+        }
+        std::sort(cells.begin(), cells.end());
+        for(size_t idx = 0; idx < baseLocations.size(); idx++) {
+            int32_t i = CellOf(baseLocations[idx].first), j = CellOf(baseLocations[idx].second);
+            minI = idx == 0 ? i : std::min(minI, i);
+            maxI = idx == 0 ? i : std::max(maxI, i);
+            minJ = idx == 0 ? j : std::min(minJ, j);
+            maxJ = idx == 0 ? j : std::max(maxJ, j);
+        }
+    }
+
+    size_t size() const { return baseLocations.size(); }
+    const std::pair<location_t, location_t>& get_baseLocation(elementId_t element) const { return baseLocations.at(element); }
+
+    // appends every element whose grid cell is within distance of (x, y). this is a superset of the
+    // elements actually within distance; the caller does the exact check
+    void GetCandidates(location_t x, location_t y, location_t distance, std::vector<elementId_t> *out) const {
+        if(cells.empty() || !(distance >= 0)) {
+            return;
+        }
+        // the walk is clamped to the cells that hold elements, so a large distance does not visit
+        // empty space; and once the window has more cells than there are elements it is cheaper
+        // to check every element's cell than to look each cell up
+        double reach = std::ceil((double)distance / cellSize);
+        double cx = std::floor((double)x / cellSize), cy = std::floor((double)y / cellSize);
+        int64_t loI = (int64_t)std::max<double>(cx - reach, minI), hiI = (int64_t)std::min<double>(cx + reach, maxI);
+        int64_t loJ = (int64_t)std::max<double>(cy - reach, minJ), hiJ = (int64_t)std::min<double>(cy + reach, maxJ);
+        if(loI > hiI || loJ > hiJ) {
+            return;
+        }
+        if((double)(hiI - loI + 1) * (hiJ - loJ + 1) > cells.size()) {
+            for(const auto &cell : cells) {
+                int32_t i = (int32_t)(cell.first >> 32), j = (int32_t)(uint32_t)cell.first;
+                if(i >= loI && i <= hiI && j >= loJ && j <= hiJ) {
+                    out->push_back(cell.second);
+                }
+            }
+            return;
+        }
+        for(int64_t i = loI; i <= hiI; i++) {
+            for(int64_t j = loJ; j <= hiJ; j++) {
+                uint64_t key = CellKey((int32_t)i, (int32_t)j);
+                auto it = std::lower_bound(cells.begin(), cells.end(), std::pair<uint64_t, elementId_t>(key, 0));
+                for(; it != cells.end() && it->first == key; ++it) {
+                    out->push_back(it->second);
+                }
+            }
+        }
+    }
+
+private:
+    int32_t CellOf(location_t v) const { return (int32_t)std::floor(v / cellSize); }
+    static uint64_t CellKey(int32_t i, int32_t j) { return ((uint64_t)(uint32_t)i << 32) | (uint32_t)j; }
+
+    std::vector<std::pair<location_t, location_t>> baseLocations;
+    location_t cellSize;
+    // (cell, element) sorted by cell, and the range of cells they cover
+    std::vector<std::pair<uint64_t, elementId_t>> cells;
+    int32_t minI = 0, maxI = 0, minJ = 0, maxJ = 0;
+};
+
+// which edge server owns which elements. every edge has a site, and its region is the part of the
+// area closer to its site than to any other; it owns the elements whose base location falls in
+// its region. an edge only keeps state for the elements it owns, so what one edge holds and serves
+// grows with its region rather than with the whole deployment, and adding edges as the area grows
+// keeps it flat. like the catalog there is one of these shared by all nodes and it never changes:
+// a new partition (an edge added, retired or moved) is a new object with a higher epoch, and the
+// edges hand the elements that changed owner over to their new owners (see PeerProtocol::HandOff)
+class EdgePartition {
+public:
+    struct Edge {
+        nodeId_t id;
+        location_t x, y;
+    };
+
+    EdgePartition(const ElementCatalog &catalog, std::vector<Edge> edges_, uint32_t epoch_): edges(std::move(edges_)), epoch(epoch_) {
+        std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.id < b.id; });
+        owned.resize(edges.size());
+        owner.reserve(catalog.size());
+        for(size_t idx = 0; idx < catalog.size(); idx++) {
+            const std::pair<location_t, location_t> &location = catalog.get_baseLocation((elementId_t)idx);
+            // ties go to the lowest id, so every node works out the same owner
+            size_t best = 0;
+            location_t bestDistance = 0;
+            for(size_t e = 0; e < edges.size(); e++) {
+                location_t xdiff = edges[e].x - location.first;
+                location_t ydiff = edges[e].y - location.second;
+                location_t distance = xdiff*xdiff + ydiff*ydiff;
+                if(e == 0 || distance < bestDistance) {
+                    best = e;
+                    bestDistance = distance;
+                }
+            }
+            owner.push_back(edges.empty() ? UINT32_MAX : edges[best].id);
+            if(!edges.empty()) {
+                owned[best].push_back((elementId_t)idx);
+            }
+        }
+    }
+
+    size_t size() const { return edges.size(); }
+    const Edge& get_edge(size_t idx) const { return edges.at(idx); }
+    uint32_t get_epoch() const { return epoch; }
+
+    // the edge owning the element, or UINT32_MAX if there are no edges
+    nodeId_t OwnerOf(elementId_t element) const { return element < owner.size() ? owner[element] : UINT32_MAX; }
+
+    // the elements the edge owns, sorted. empty for a node that is not an edge
+    const std::vector<elementId_t>& get_owned(nodeId_t edge) const {
+        static const std::vector<elementId_t> none;
+        size_t idx = IndexOf(edge);
+        return idx == edges.size() ? none : owned[idx];
+    }
+
+private:
+    size_t IndexOf(nodeId_t n) const {
+        auto it = std::lower_bound(edges.begin(), edges.end(), n, [](const Edge &e, nodeId_t id) { return e.id < id; });
+        return it != edges.end() && it->id == n ? it - edges.begin() : edges.size();
+    }
+
+    // sorted by id
+    std::vector<Edge> edges;
+    uint32_t epoch;
+    // by element, and by edge in the order of edges
+    std::vector<nodeId_t> owner;
+    std::vector<std::vector<elementId_t>> owned;
+};
+
+// read-only view over the (element, version, round) entries of an advert, decoded on access.
+// adverts are written in element order, which lets find() binary search; a view over entries
+// that are out of order has to be told so and falls back to a scan
+class PackedAdvertEntries {
+public:
+    static const size_t entrySize = 4;
+
+    PackedAdvertEntries(): data(nullptr), count(0), sorted(true) {}
+    PackedAdvertEntries(const uint8_t *d, size_t n, bool s = true): data(d), count(n), sorted(s) {}
+
+    size_t size() const { return count; }
+    const uint8_t* bytes() const { return data; }
+    elementId_t element(size_t idx) const { return oneByteToTwo(data + entrySize*idx); }
+    causalNum_t version(size_t idx) const { return data[entrySize*idx + 2]; }
+    causalNum_t round(size_t idx) const { return data[entrySize*idx + 3]; }
+
+    bool is_sorted() const {
+        for(size_t idx = 1; idx < count; idx++) {
+            if(element(idx) < element(idx - 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // index of the entry for element, or size() if it was not advertised
+    size_t find(elementId_t e) const {
+        if(!sorted) {
+            for(size_t idx = 0; idx < count; idx++) {
+                if(element(idx) == e) {
+                    return idx;
+                }
+            }
+            return count;
+        }
+        size_t lo = 0, hi = count;
+        while(lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if(element(mid) < e) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return (lo < count && element(lo) == e) ? lo : count;
+    }
+private:
+    const uint8_t *data;
+    size_t count;
+    bool sorted;
+};
+
+// FNV-1a, used to tell whether a neighbor's advert changed since the last one. cheap, but anyone
+// can make two inputs collide, so nothing that trusts the bytes behind it may use it
+inline uint64_t digestBytes(const uint8_t *data, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t idx = 0; idx < len; idx++) {
+        h = (h ^ data[idx]) * 1099511628211ULL;
+    }
+    return h ^ len;
+}
+
+// the name of a payload chunk: the first 64 bits of the SHA-256 of its bytes. a chunk arrives from
+// whichever neighbor answers, so its name has to be one nobody can find other bytes for. forging
+// bytes for a name someone else published takes about 2^64 work. the author of an element can
+// still pick two chunks that share a name in about 2^32, but it could write any data it liked anyway
+inline chunkHash_t chunkDigest(const uint8_t *data, size_t len) {
+    Sha256 sha;
+    sha.Update(data, len);
+    uint8_t out[32];
+    sha.Final(out);
+    chunkHash_t h = 0;
+    for(int idx = 0; idx < 8; idx++) {
+        h = h << 8 | out[idx];
+    }
+    return h;
+}
+
+#include "advert_kernels.h"
+
+// splits a payload into chunks at boundaries picked by its content, not by offset: a gear hash
+// rolls over the bytes and a chunk ends where the top bits of the hash are all zero. an edit then
+// only moves the boundaries right around it, and every chunk before and after keeps its bytes and
+// so its hash, even when the edit inserts or removes bytes. chunks average about avgSize bytes,
+// rounded down to a power of two, and are never shorter than avgSize/4 or longer than maxSize
+// (except the last, which may be shorter). appends (offset, length) pairs
+inline void SplitPayload(const uint8_t *data, size_t len, size_t avgSize, size_t maxSize, std::vector<std::pair<size_t, size_t>> *out) {
+    static const std::vector<uint64_t> gear = []() {
+        // splitmix64, so every build has the same table and the same boundaries
+        std::vector<uint64_t> table(256);
+        uint64_t x = 0;
+        for(uint64_t &g : table) {
+            uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            g = z ^ (z >> 31);
+        }
+        return table;
+    }();
+    int bits = 0;
+    while(((size_t)2 << bits) <= avgSize) {
+        bits++;
+    }
+    uint64_t mask = bits == 0 ? 0 : ~0ULL << (64 - bits);
+    size_t minSize = std::max<size_t>(avgSize / 4, 1);
+    maxSize = std::max(maxSize, minSize);
+
+    size_t begin = 0;
+    while(begin < len) {
+        size_t end = std::min(begin + maxSize, len);
+        uint64_t h = 0;
+        for(size_t idx = begin + minSize; idx < end; idx++) {
+            h = (h << 1) + gear[data[idx]];
+            if((h & mask) == 0) {
+                end = idx + 1;
+                break;
+            }
+        }
+        out->push_back(std::pair<size_t, size_t>(begin, end - begin));
+        begin = end;
+    }
+}
+
+// the payload chunks a node holds, named by chunkDigest() of their bytes, so a chunk that several
+// elements or several versions of one element have in common is stored and sent once. a chunk is
+// kept while some element's payload refers to it. one that is referred to but has not arrived is
+// missing; it remembers an element it belongs to and the node it was first heard of from, which
+// is where it gets asked for
+class ChunkStore {
+public:
+    struct Chunk {
+        std::vector<uint8_t> bytes;
+        bool present = false;
+        uint32_t refs = 0;
+        elementId_t element = 0;
+        nodeId_t source = 0;
+        // when it was last asked for, and how many times it has been
+        int64_t requestedAt = 0;
+        uint32_t requests = 0;
+    };
+
+    // adds a reference to a chunk, which is missing if we do not hold it yet
+    void Retain(chunkHash_t hash, elementId_t element, nodeId_t source) {
+        Chunk &c = chunks[hash];
+        if(c.refs++ == 0 && !c.present) {
+            c.element = element;
+            c.source = source;
+            missing.insert(hash);
+        }
+    }
+
+    void Release(chunkHash_t hash) {
+        auto it = chunks.find(hash);
+        if(it == chunks.end() || --it->second.refs > 0) {
+            return;
+        }
+        if(it->second.present) {
+            storedBytes -= it->second.bytes.size();
+        }
+        missing.erase(hash);
+        chunks.erase(it);
+    }
+
+    // stores the bytes of a missing chunk. false if nothing refers to the hash, we already hold it,
+    // or the bytes do not match it
+    bool Fill(chunkHash_t hash, const uint8_t *data, size_t len) {
+        auto it = chunks.find(hash);
+        if(it == chunks.end() || it->second.present || chunkDigest(data, len) != hash) {
+            return false;
+        }
+        it->second.bytes.assign(data, data + len);
+        it->second.present = true;
+        storedBytes += len;
+        missing.erase(hash);
+        return true;
+    }
+
+    // the chunk if we hold it
+    const Chunk* Find(chunkHash_t hash) const {
+        auto it = chunks.find(hash);
+        return it == chunks.end() || !it->second.present ? nullptr : &it->second;
+    }
+
+    // forgets that any missing chunk has been asked for, so they are all asked for afresh
+    void ResetRequests() {
+        for(chunkHash_t hash : missing) {
+            chunks.at(hash).requests = 0;
+        }
+    }
+
+    Chunk& at(chunkHash_t hash) { return chunks.at(hash); }
+    const std::set<chunkHash_t>& get_missing() const { return missing; }
+    const std::map<chunkHash_t, Chunk>& get_chunks() const { return chunks; }
+    size_t held() const { return chunks.size() - missing.size(); }
+    size_t bytes() const { return storedBytes; }
+
+    void clear() {
+        chunks.clear();
+        missing.clear();
+        storedBytes = 0;
+    }
+
+private:
+    std::map<chunkHash_t, Chunk> chunks;
+    std::set<chunkHash_t> missing;
+    size_t storedBytes = 0;
+};
+
+class nodeEntry {
+public:
+    uint32_t address;
+    int64_t recentTime;
+    // the entries of the neighbor's last advert exactly as they came off the wire. they are only
+    // decoded when someone asks about a particular element; anything missing is (0, 0)
+    std::vector<uint8_t> advertEntries;
+    bool advertSorted;
+
+    // which generation of our own state the last advert was compared against, and whether that
+    // comparison found anything better than ours
+    uint32_t comparedGeneration;
+    bool aheadOfUs;
+    // the sync epoch in which this neighbor was last confirmed in our sync groups from its advert
+    uint32_t confirmedEpoch;
+
+    // an advert that came in ADVERT_PARTs, as far as it has been received in order
+    std::vector<uint8_t> pendingAdvert;
+    uint8_t pendingPart;
+
+    nodeEntry(uint32_t ad, int64_t time): address(ad), recentTime(time), advertSorted(true), comparedGeneration(UINT32_MAX), aheadOfUs(false), confirmedEpoch(UINT32_MAX), pendingPart(0) {
+    }
+
+    PackedAdvertEntries get_advert() const {
+        return PackedAdvertEntries(advertEntries.data(), advertEntries.size() / PackedAdvertEntries::entrySize, advertSorted);
+    }
+
+    std::pair<causalNum_t, causalNum_t> get_versionRound(elementId_t element) const {
+        PackedAdvertEntries advert = get_advert();
+        size_t idx = advert.find(element);
+        if(idx == advert.size()) {
+            return std::pair<causalNum_t, causalNum_t>{0, 0};
+        }
+        return std::pair<causalNum_t, causalNum_t>{advert.version(idx), advert.round(idx)};
+    }
+
+    friend std::ostream& operator<< (std::ostream &os, const nodeEntry &n) {
+        os << "Address: " << ((n.address >> 24) & 0xFF) << "." << ((n.address >> 16) & 0xFF) << "."
+           << ((n.address >> 8) & 0xFF) << "." << (n.address & 0xFF) << "\nHeartbeat Time: " << n.recentTime  << std::endl;
+        PackedAdvertEntries advert = n.get_advert();
+        for(size_t idx = 0; idx < advert.size(); idx++) {
+            os << "Element: " << unsigned(advert.element(idx)) << " Version: " << unsigned(advert.version(idx)) << " Round: " << unsigned(advert.round(idx)) << std::endl;
+        }
+        return os;
+    }
+private:
+};
+
+// all of the message classes below are views when deserialized: they hold pointers into the
+// receive buffer rather than copies, so they must not outlive it. serialize() overwrites a
+// caller-owned buffer so the sender can reuse one buffer (and its capacity) for every message.
+// deserialize() returns false, and reads nothing, when the buffer is shorter than the header
+
+/* FORMAT
+ * | type   | nodeid | ipv4   |
+ * |element |version | round  | ...
+ *
+ * | 8 bit  | 32 bit | 32 bit |
+ * | 16 bit | 8 bit  |  8 bit | ...
+ *
+ */
+class ADVERT_Message {
+public:
+    static const size_t headerSize = 9;
+
+    nodeId_t senderId;
+    uint32_t ipv4Address;
+    PackedAdvertEntries entries;
+
+    static void serialize(nodeId_t id,
+            uint32_t ad,
+            const std::vector<elementId_t> &nearbyElements,
+            const std::map<elementId_t, AgreementInformation> &elementInfo,
+            std::vector<uint8_t> *mesg)
+    {
+        mesg->clear();
+        mesg->push_back(ADVERT);
+        fourByteToOne(id, mesg);
+        fourByteToOne(ad, mesg);
+        serializeEntries(nearbyElements, elementInfo, mesg);
+    }
+
+    // appends just the entries, without the header
+    static void serializeEntries(const std::vector<elementId_t> &nearbyElements,
+            const std::map<elementId_t, AgreementInformation> &elementInfo,
+            std::vector<uint8_t> *mesg)
+    {
+        for(elementId_t element : nearbyElements) {
+            const AgreementInformation &info = elementInfo.at(element);
+            twoByteToOne(element, mesg);
+            mesg->push_back(info.get_version());
+            mesg->push_back(info.get_round());
+        }
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, ADVERT_Message *m) {
+        // recall that the message is structured as:
+        // element id - version number - round number
+        // a trailing partial entry is ignored. whether the entries are in order is not checked here;
+        // that costs a pass over them and most receivers never need to know
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->ipv4Address = oneByteToFour(buf + 5);
+        m->entries = PackedAdvertEntries(buf + headerSize, (len - headerSize)/PackedAdvertEntries::entrySize);
+        return true;
+    }
+
+    friend std::ostream& operator<< (std::ostream &os, const ADVERT_Message &a) {
+        os << "Id: " << unsigned(a.senderId) << "\nAddress: " << unsigned(a.ipv4Address)  << std::endl;
+        for(size_t idx = 0; idx < a.entries.size(); idx++) {
+            os << "Element: " << unsigned(a.entries.element(idx)) << " Version: " << unsigned(a.entries.version(idx)) << " Round: " << unsigned(a.entries.round(idx)) << std::endl;
+        }
+        return os;
+    }
+};
+
+/* FORMAT
+ * | type   | nodeid |element |
+ *
+ * | 8 bit  | 32 bit | 16 bit |
+ *
+ */
+class REQUEST_DATA_Message {
+public:
+    static const size_t headerSize = 7;
+
+    nodeId_t senderId;
+    elementId_t elementId;
+
+    REQUEST_DATA_Message(): senderId(0), elementId(0) {
+    }
+    REQUEST_DATA_Message(nodeId_t nid, elementId_t eid): senderId(nid), elementId(eid) {
+    }
+
+    void serialize(std::vector<uint8_t> *mesg) const {
+        mesg->clear();
+        mesg->push_back(REQUEST_DATA);
+        fourByteToOne(this->senderId, mesg);
+        twoByteToOne(this->elementId, mesg);
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, REQUEST_DATA_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elementId = oneByteToTwo(buf + 5);
+        return true;
+    }
+
+    friend std::ostream& operator<< (std::ostream &os, const REQUEST_DATA_Message &r) {
+        os << "Id: " << unsigned(r.senderId) << "\nElement: " << unsigned(r.elementId)  << std::endl;
+        return os;
+    }
+};
+
+/* FORMAT
+ * |type    |nodeid  |element |
+ * |x pos   |y pos   |
+ * |version |round   |chunks  |
+ * |hash    |...
+ * |members |...
+ *
+ * |8 bit   |32 bit  |16 bit  |
+ * |32 bit  |32 bit  |
+ * |8 bit   |8 bit   |16 bit  |
+ * |64 bit  |...
+ * |32 bit  |8 bit   |...
+ *
+ * the hashes are the payload's chunks in order; the receiver fetches the ones it lacks with
+ * REQUEST_CHUNKS. each member is a node id and how many sync epochs ago the sender last confirmed
+ * it. only members inside the sender's sync horizon are sent, newest first
+ */
+class SEND_DATA_Message {
+public:
+    static const size_t headerSize = 19;
+
+    nodeId_t senderId;
+    elementId_t elementId;
+    location_t xpos, ypos;
+    causalNum_t version, round;
+
+    PackedHashes payload;
+    PackedMembers sync_group;
+
+    static void serialize(nodeId_t nid, elementId_t eid, const AgreementInformation &elem, uint32_t epoch, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(SEND_DATA);
+        fourByteToOne(nid, mesg);
+        twoByteToOne(eid, mesg);
+
+        uint32_t serialized_xpos, serialized_ypos;
+        std::memcpy(&serialized_xpos, &elem.get_fineLocation().first, 4);
+        std::memcpy(&serialized_ypos, &elem.get_fineLocation().second, 4);
+        fourByteToOne(serialized_xpos, mesg);
+        fourByteToOne(serialized_ypos, mesg);
+
+        mesg->push_back(elem.get_version());
+        mesg->push_back(elem.get_round());
+
+        twoByteToOne(elem.get_payload().size(), mesg);
+        for(chunkHash_t hash : elem.get_payload()) {
+            eightByteToOne(hash, mesg);
+        }
+
+        elem.get_agreeingNodes().forEach(epoch, [mesg](nodeId_t nodeId, uint8_t age) {
+            fourByteToOne(nodeId, mesg);
+            mesg->push_back(age);
+        });
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SEND_DATA_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elementId = oneByteToTwo(buf + 5);
+
+        uint32_t packed_x = oneByteToFour(buf + 7);
+        uint32_t packed_y = oneByteToFour(buf + 11);
+        std::memcpy(&m->xpos, &packed_x, 4);
+        std::memcpy(&m->ypos, &packed_y, 4);
+
+        m->version = buf[15];
+        m->round = buf[16];
+        // a hash count that runs past the end of the message is cut to what is there
+        size_t hashes = std::min<size_t>(oneByteToTwo(buf + 17), (len - headerSize)/PackedHashes::hashSize);
+        m->payload = PackedHashes(buf + headerSize, hashes);
+        size_t members = headerSize + hashes*PackedHashes::hashSize;
+        m->sync_group = PackedMembers(buf + members, (len - members)/PackedMembers::memberSize);
+        return true;
+    }
+
+    friend std::ostream& operator<< (std::ostream &os, const SEND_DATA_Message &s) {
+            os << "Id: " << unsigned(s.senderId) << "\nElement: " << unsigned(s.elementId)  << std::endl;
+            os << "Location: (" << s.xpos << ", " << s.ypos << ")\n";
+            os << "Version: " << unsigned(s.version) << " Round: " << unsigned(s.round) << std::endl;
+            os << "Payload chunks: " << s.payload.size() << std::endl;
+            for(size_t idx = 0; idx < s.sync_group.size(); idx++) {
+                os << "Node: " << s.sync_group.id(idx) << " Age: " << unsigned(s.sync_group.age(idx)) << std::endl;
+            }
+            return os;
+        }
+};
+
+class ACK_Message {
+public:
+    static const size_t headerSize = 7;
+
+    nodeId_t senderId;
+    elementId_t elementId;
+
+    ACK_Message(): senderId(0), elementId(0) {
+    }
+    ACK_Message(nodeId_t nid, elementId_t eid): senderId(nid), elementId(eid) {
+    }
+
+    void serialize(std::vector<uint8_t> *mesg) const {
+        mesg->clear();
+        mesg->push_back(ACK);
+        fourByteToOne(this->senderId, mesg);
+        twoByteToOne(this->elementId, mesg);
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, ACK_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elementId = oneByteToTwo(buf + 5);
+        return true;
+    }
+
+    friend std::ostream& operator<< (std::ostream &os, const ACK_Message &a) {
+        os << "Id: " << unsigned(a.senderId) << "\nElement: " << unsigned(a.elementId)  << std::endl;
+        return os;
+    }
+};
+
+// anything that would not fit in one datagram is split at the application level, so that losing
+// one piece costs one piece rather than the whole IP-fragmented message.
+//
+// an advert that is too big goes out as a run of ADVERT_PARTs back to back, each carrying a slice
+// of the entries in element order. the receiver only takes the advert once it has every part in
+// sequence; if one is lost it keeps the previous advert until the next beacon
+
+/* FORMAT
+ * | type   | nodeid | ipv4   | part   | parts  |
+ * |element |version | round  | ...
+ *
+ * | 8 bit  | 32 bit | 32 bit | 8 bit  | 8 bit  |
+ * | 16 bit | 8 bit  |  8 bit | ...
+ *
+ */
+class ADVERT_PART_Message {
+public:
+    static const size_t headerSize = 11;
+
+    nodeId_t senderId;
+    uint32_t ipv4Address;
+    uint8_t part, parts;
+    PackedAdvertEntries entries;
+
+    static void serialize(nodeId_t id, uint32_t ad, uint8_t part, uint8_t parts, const uint8_t *entries, size_t numEntries, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(ADVERT_PART);
+        fourByteToOne(id, mesg);
+        fourByteToOne(ad, mesg);
+        mesg->push_back(part);
+        mesg->push_back(parts);
+        mesg->insert(mesg->end(), entries, entries + numEntries*PackedAdvertEntries::entrySize);
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, ADVERT_PART_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->ipv4Address = oneByteToFour(buf + 5);
+        m->part = buf[9];
+        m->parts = buf[10];
+        m->entries = PackedAdvertEntries(buf + headerSize, (len - headerSize)/PackedAdvertEntries::entrySize);
+        return true;
+    }
+};
+
+// a SEND_DATA that is too big is sent as numbered chunks of its serialized bytes. the receiver
+// answers every chunk with a CHUNK_ACK holding a bitmap of all chunks it has so far, and the
+// sender only ever retransmits chunks missing from the latest bitmap. the transfer id is a digest
+// of the whole message, so when the same state is requested again the receiver keeps the chunks
+// it already has and the transfer resumes instead of starting over.
+//
+// chunk i covers bytes [i*chunkSize, min((i+1)*chunkSize, total)) with chunkSize = ceil(total/chunks)
+
+/* FORMAT
+ * | type   | nodeid |element |
+ * |transfer| total  | chunk  | chunks |
+ * |payload |...
+ *
+ * | 8 bit  | 32 bit | 16 bit |
+ * | 32 bit | 32 bit | 16 bit | 16 bit |
+ * | 8 bit  |...
+ *
+ */
+class SEND_DATA_CHUNK_Message {
+public:
+    static const size_t headerSize = 19;
+
+    nodeId_t senderId;
+    elementId_t elementId;
+    uint32_t transferId;
+    uint32_t total;
+    uint16_t chunk, chunks;
+    const uint8_t *payload;
+    size_t payloadSize;
+
+    static size_t ChunkSize(uint32_t total, uint16_t chunks) { return (total + chunks - 1) / chunks; }
+
+    static void serialize(nodeId_t nid, elementId_t eid, uint32_t transfer, const std::vector<uint8_t> &whole, uint16_t chunk, uint16_t chunks, std::vector<uint8_t> *mesg) {
+        size_t chunkSize = ChunkSize(whole.size(), chunks);
+        size_t begin = chunk * chunkSize;
+        size_t end = std::min(begin + chunkSize, whole.size());
+
+        mesg->clear();
+        mesg->push_back(SEND_DATA_CHUNK);
+        fourByteToOne(nid, mesg);
+        twoByteToOne(eid, mesg);
+        fourByteToOne(transfer, mesg);
+        fourByteToOne(whole.size(), mesg);
+        twoByteToOne(chunk, mesg);
+        twoByteToOne(chunks, mesg);
+        mesg->insert(mesg->end(), whole.begin() + begin, whole.begin() + end);
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SEND_DATA_CHUNK_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elementId = oneByteToTwo(buf + 5);
+        m->transferId = oneByteToFour(buf + 7);
+        m->total = oneByteToFour(buf + 11);
+        m->chunk = oneByteToTwo(buf + 15);
+        m->chunks = oneByteToTwo(buf + 17);
+        m->payload = buf + headerSize;
+        m->payloadSize = len - headerSize;
+        return true;
+    }
+};
+
+/* FORMAT
+ * | type   | nodeid |element |
+ * |transfer| chunks |
+ * |bitmap  |...
+ *
+ * | 8 bit  | 32 bit | 16 bit |
+ * | 32 bit | 16 bit |
+ * | 8 bit  |...
+ *
+ * bit i of the bitmap (byte i/8, bit i%8) is set when chunk i has arrived
+ */
+class CHUNK_ACK_Message {
+public:
+    static const size_t headerSize = 13;
+
+    nodeId_t senderId;
+    elementId_t elementId;
+    uint32_t transferId;
+    uint16_t chunks;
+    const uint8_t *bitmap;
+    size_t bitmapSize;
+
+    bool has(uint16_t chunk) const {
+        return (size_t)(chunk / 8) < bitmapSize && ((bitmap[chunk / 8] >> (chunk % 8)) & 1);
+    }
+
+    static void serialize(nodeId_t nid, elementId_t eid, uint32_t transfer, uint16_t chunks, const std::vector<uint8_t> &bitmap, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(CHUNK_ACK);
+        fourByteToOne(nid, mesg);
+        twoByteToOne(eid, mesg);
+        fourByteToOne(transfer, mesg);
+        twoByteToOne(chunks, mesg);
+        mesg->insert(mesg->end(), bitmap.begin(), bitmap.end());
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, CHUNK_ACK_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elementId = oneByteToTwo(buf + 5);
+        m->transferId = oneByteToFour(buf + 7);
+        m->chunks = oneByteToTwo(buf + 11);
+        m->bitmap = buf + headerSize;
+        m->bitmapSize = len - headerSize;
+        return true;
+    }
+};
+
+// payload chunks are fetched separately from the agreement state. a node missing chunks asks a
+// neighbor for them by hash with REQUEST_CHUNKS, and the neighbor answers every chunk it holds
+// with a SEND_CHUNK. lost requests and answers are simply asked for again, from another neighbor
+// if there is one; the receiver checks the bytes against the hash so it does not matter who answers
+
+/* FORMAT
+ * | type   | nodeid |
+ * | hash   |...
+ *
+ * | 8 bit  | 32 bit |
+ * | 64 bit |...
+ *
+ */
+class REQUEST_CHUNKS_Message {
+public:
+    static const size_t headerSize = 5;
+
+    nodeId_t senderId;
+    PackedHashes hashes;
+
+    static void serialize(nodeId_t nid, const std::vector<chunkHash_t> &hashes, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(REQUEST_CHUNKS);
+        fourByteToOne(nid, mesg);
+        for(chunkHash_t hash : hashes) {
+            eightByteToOne(hash, mesg);
+        }
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, REQUEST_CHUNKS_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->hashes = PackedHashes(buf + headerSize, (len - headerSize)/PackedHashes::hashSize);
+        return true;
+    }
+};
+
+/* FORMAT
+ * | type   | nodeid | hash   |
+ * | bytes  |...
+ *
+ * | 8 bit  | 32 bit | 64 bit |
+ * | 8 bit  |...
+ *
+ */
+class SEND_CHUNK_Message {
+public:
+    static const size_t headerSize = 13;
+
+    nodeId_t senderId;
+    chunkHash_t hash;
+    const uint8_t *bytes;
+    size_t size;
+
+    static void serialize(nodeId_t nid, chunkHash_t hash, const std::vector<uint8_t> &bytes, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(SEND_CHUNK);
+        fourByteToOne(nid, mesg);
+        eightByteToOne(hash, mesg);
+        mesg->insert(mesg->end(), bytes.begin(), bytes.end());
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SEND_CHUNK_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->hash = oneByteToEight(buf + 5);
+        m->bytes = buf + headerSize;
+        m->size = len - headerSize;
+        return true;
+    }
+};
+
+// a node coming back after time away (see PeerProtocol::Rejoin) still has the state it left
+// with, and most of it is usually current. rather than pulling each element it has fallen behind
+// on with its own REQUEST_DATA, SEND_DATA and ACK, it sends the first neighbor that advertises
+// newer states one SYNC_DIGEST with its own version and round of each of those elements. the
+// neighbor answers with every state it has that is newer, packed into as few SYNC_DATAs as fit,
+// and the returning node acknowledges them all with one SYNC_ACK. it keeps sending digests, at
+// most one per chunkRetryTimeout, until no neighbor is ahead of it
+
+/* FORMAT
+ * | type   | nodeid | ipv4   |
+ * |element |version | round  | ...
+ *
+ * | 8 bit  | 32 bit | 32 bit |
+ * | 16 bit | 8 bit  |  8 bit | ...
+ *
+ * the address is where to answer: a node that just came back may hear its neighbors' beacons
+ * before they have heard its own
+ */
+class SYNC_DIGEST_Message {
+public:
+    static const size_t headerSize = 9;
+
+    nodeId_t senderId;
+    uint32_t ipv4Address;
+    PackedAdvertEntries entries;
+
+    static void serialize(nodeId_t nid,
+            uint32_t ad,
+            const std::vector<elementId_t> &elements,
+            const std::map<elementId_t, AgreementInformation> &elementInfo,
+            std::vector<uint8_t> *mesg)
+    {
+        mesg->clear();
+        mesg->push_back(SYNC_DIGEST);
+        fourByteToOne(nid, mesg);
+        fourByteToOne(ad, mesg);
+        ADVERT_Message::serializeEntries(elements, elementInfo, mesg);
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SYNC_DIGEST_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->ipv4Address = oneByteToFour(buf + 5);
+        m->entries = PackedAdvertEntries(buf + headerSize, (len - headerSize)/PackedAdvertEntries::entrySize, false);
+        return true;
+    }
+};
+
+/* FORMAT
+ * | type   | nodeid |
+ * | length |SEND_DATA ...| ...
+ *
+ * | 8 bit  | 32 bit |
+ * | 16 bit |length bytes | ...
+ *
+ * each state is a whole SEND_DATA message, as it would have been sent on its own
+ */
+class SYNC_DATA_Message {
+public:
+    static const size_t headerSize = 5;
+
+    nodeId_t senderId;
+    const uint8_t *states;
+    size_t size;
+
+    // calls f(buf, len) for every SEND_DATA inside. one whose length runs past the end ends the walk
+    template<typename F>
+    void forEach(F f) const {
+        size_t pos = 0;
+        while(size - pos >= 2) {
+            size_t len = oneByteToTwo(states + pos);
+            pos += 2;
+            if(size - pos < len) {
+                return;
+            }
+            if(len >= SEND_DATA_Message::headerSize && states[pos] == SEND_DATA) {
+                f(states + pos, len);
+            }
+            pos += len;
+        }
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SYNC_DATA_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->states = buf + headerSize;
+        m->size = len - headerSize;
+        return true;
+    }
+};
+
+/* FORMAT
+ * | type   | nodeid |
+ * |element |...
+ *
+ * | 8 bit  | 32 bit |
+ * | 16 bit |...
+ *
+ */
+class SYNC_ACK_Message {
+public:
+    static const size_t headerSize = 5;
+
+    nodeId_t senderId;
+    const uint8_t *elements;
+    size_t count;
+
+    elementId_t element(size_t idx) const { return oneByteToTwo(elements + 2*idx); }
+
+    static void serialize(nodeId_t nid, const std::vector<elementId_t> &elements, std::vector<uint8_t> *mesg) {
+        mesg->clear();
+        mesg->push_back(SYNC_ACK);
+        fourByteToOne(nid, mesg);
+        for(elementId_t element : elements) {
+            twoByteToOne(element, mesg);
+        }
+    }
+
+    static bool deserialize(const uint8_t *buf, size_t len, SYNC_ACK_Message *m) {
+        if(len < headerSize) {
+            return false;
+        }
+        m->senderId = oneByteToFour(buf + 1);
+        m->elements = buf + headerSize;
+        m->count = (len - headerSize) / 2;
+        return true;
+    }
+};
+
+// a chunked SEND_DATA on its way out
+struct OutgoingTransfer {
+    uint32_t address;
+    uint32_t transferId;
+    std::vector<uint8_t> whole;
+    uint16_t chunks;
+    std::vector<bool> acked;
+    int64_t lastSent;
+    uint32_t retries;
+};
+
+// a chunked SEND_DATA being put back together. once complete it is kept until it times out, so
+// that chunks retransmitted after a lost CHUNK_ACK are answered instead of starting a new transfer
+struct IncomingTransfer {
+    uint32_t transferId;
+    uint32_t total;
+    uint16_t chunks;
+    std::vector<uint8_t> whole;
+    std::vector<uint8_t> bitmap;
+    uint16_t received;
+    int64_t lastHeard;
+};
+
+// whatever carries messages between peers. in the simulation this is the application's
+// udp sockets; standalone drivers provide their own
+class PeerTransport {
+public:
+    virtual ~PeerTransport() {}
+    virtual void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) = 0;
+};
+
+// the agreement state of one peer and the rules for updating it. all time is passed in
+// as milliseconds so that the caller decides what clock drives it.
+//
+// agreement state for an element is only created once the node comes within reach of it or is
+// sent it, so a node's memory grows with the elements it has encountered rather than with the catalog
+class PeerProtocol {
+public:
+    uint32_t heartbeatTimeout = 10000;
+    location_t nearbyDistance = 8.0f;
+    // the largest message handed to the transport. the default is a 1500 byte MTU less the
+    // IP and UDP headers; the simulation sets it from the device
+    size_t maxMessageSize = 1472;
+    // chunked transfers: unacknowledged chunks are resent after chunkRetryTimeout, up to
+    // maxChunkRetries times. an incoming transfer nobody has sent to for transferTimeout is dropped
+    uint32_t chunkRetryTimeout = 200;
+    uint32_t maxChunkRetries = 10;
+    uint32_t transferTimeout = 10000;
+    // sync groups remember the nodes confirmed within the last syncHorizon epochs of
+    // syncEpochLength milliseconds. a node is confirmed when it ACKs us, sends us the element,
+    // or advertises the same version and round as ours
+    uint32_t syncEpochLength = 5000;
+    uint32_t syncHorizon = 6;
+    // each node's view of an element starts at the catalog location plus noise in
+    // [-locationNoiseRange, locationNoiseRange], drawn from locationNoise
+    location_t locationNoiseRange = 0.5f;
+    std::function<location_t()> locationNoise;
+    // optional push dissemination. when this node creates a newer state for an element, or adopts
+    // one from a SEND_DATA, it sends that SEND_DATA unasked to up to pushFanout neighbors whose
+    // last advert showed an older state for the element, rather than waiting for them to see our
+    // next beacon and ask. 0 turns pushing off.
+    //
+    // rumors stop on their own: a node pushes a state only at the moment it moves to it, only to
+    // neighbors that advertise the element and are behind on it, never back to the node it came
+    // from, and a state that is not newer than what the receiver has is dropped without going any
+    // further. on top of that, a state that arrived by SEND_DATA is passed on with probability
+    // pushForwardProbability, so a rumor can also die out before it reaches the whole group.
+    // pushRandom returns uniform values in [0, 1) for picking neighbors and for the forwarding
+    // coin; without it the first neighbors in id order are picked and every rumor is forwarded
+    uint32_t pushFanout = 0;
+    double pushForwardProbability = 1.0;
+    std::function<double()> pushRandom;
+    // payloads are cut into chunks of about payloadChunkSize bytes (see SplitPayload), none bigger
+    // than fits in one SEND_CHUNK. at most maxChunksInFlight missing chunks are asked for at a time;
+    // one still missing after chunkRetryTimeout is asked for again, backing off each time
+    size_t payloadChunkSize = 1024;
+    uint32_t maxChunksInFlight = 32;
+    // the edge servers and the elements each owns, if there are any. an edge runs this same
+    // protocol near exactly the elements it owns, so it advertises and serves them like any peer;
+    // a peer pulling an element goes to its owning edge whenever that edge is in reach and
+    // has the newest state, and only falls back to another neighbor when it does not
+    std::shared_ptr<const EdgePartition> edgePartition;
+
+    PeerProtocol(): node_id(0), transport(nullptr) {}
+
+    void Setup(nodeId_t id, PeerTransport *transport_, std::shared_ptr<const ElementCatalog> catalog_) {
+        node_id = id;
+        transport = transport_;
+        catalog = catalog_;
+        AgreementInformation_map.clear();
+        nearbyElements.clear();
+        localGroup.clear();
+        outgoing.clear();
+        incoming.clear();
+        chunkStore.clear();
+        catchingUp = false;
+        recoveringSince = -1;
+        nearbyKnown = false;
+    }
+
+    //ask the catalog which elements could be close, see which ones youre close to (according to their fineLocation), add them to nearbyElements
+    //if you are far from an element, remove it from nearbyElements
+    void UpdateNearbyElements(location_t x, location_t y, int64_t currentTime) {
+        SetTime(currentTime);
+        // a fineLocation is within locationNoiseRange of the catalog location on each axis, so
+        // within locationNoiseRange*sqrt(2) of it. every element whose catalog location is that
+        // close to the edge of our reach could be near, and gets its state, and so its
+        // fineLocation, before that is checked
+        location_t reach = nearbyDistance + locationNoiseRange * std::sqrt(2.0f);
+        candidates.clear();
+        catalog->GetCandidates(x, y, reach, &candidates);
+
+        nowNearby.clear();
+        for(elementId_t element : candidates) {
+            const std::pair<location_t, location_t> &base = catalog->get_baseLocation(element);
+            location_t xdiff = base.first - x;
+            location_t ydiff = base.second - y;
+            if(xdiff*xdiff + ydiff*ydiff >= reach*reach) {
+                continue;
+            }
+            const std::pair<location_t, location_t> &location = GetElement(element).get_fineLocation();
+            xdiff = location.first - x;
+            ydiff = location.second - y;
+            if(xdiff*xdiff + ydiff*ydiff < nearbyDistance*nearbyDistance) {
+                nowNearby.push_back(element);
+            }
+        }
+        std::sort(nowNearby.begin(), nowNearby.end());
+        ApplyNearby();
+    }
+
+    // sets the nearby elements directly rather than from a position, for drivers that know which
+    // elements a node was near but not where it was, such as a trace replay
+    void SetNearbyElements(const std::vector<elementId_t> &elements, int64_t currentTime) {
+        SetTime(currentTime);
+        nowNearby.clear();
+        for(elementId_t element : elements) {
+            if(element < catalog->size()) {
+                nowNearby.push_back(element);
+            }
+        }
+        std::sort(nowNearby.begin(), nowNearby.end());
+        nowNearby.erase(std::unique(nowNearby.begin(), nowNearby.end()), nowNearby.end());
+        ApplyNearby();
+    }
+
+    void BeginAgreement(elementId_t element) {
+        AgreementInformation &elementInfo = GetElement(element);
+        causalNum_t ourVersion = elementInfo.get_version();
+        causalNum_t ourRound = elementInfo.get_round();
+
+        causalNum_t maxVersion = 0;
+        causalNum_t maxRound = 0;
+        nodeId_t bestNode = UINT32_MAX;
+        bool no_version = elementInfo.get_round() == 0;
+        PEER_LOG("node " << node_id << " is beginning agreement");
+        if(!localGroup.empty()) {
+            neighborKeys.clear();
+            neighborIds.clear();
+            for(const auto &node : localGroup) {
+                std::pair<causalNum_t, causalNum_t> theirs = node.second.get_versionRound(element);
+                neighborKeys.push_back(causalKey(theirs.first, theirs.second));
+                neighborIds.push_back(node.first);
+            }
+            // ties go to the first neighbor in the local group
+            size_t best = MaxKeyIndex(neighborKeys.data(), neighborKeys.size());
+            if(neighborKeys[best] != 0) {
+                maxVersion = neighborKeys[best] >> 8;
+                maxRound = neighborKeys[best] & 0xFF;
+                bestNode = neighborIds[best];
+                // unless the owning edge has the same state, see edgePartition
+                nodeId_t owner = edgePartition ? edgePartition->OwnerOf(element) : UINT32_MAX;
+                auto edge = localGroup.find(owner);
+                if(owner != bestNode && edge != localGroup.end()) {
+                    std::pair<causalNum_t, causalNum_t> theirs = edge->second.get_versionRound(element);
+                    if(causalKey(theirs.first, theirs.second) == neighborKeys[best]) {
+                        bestNode = owner;
+                    }
+                }
+            }
+            if(ourVersion < maxVersion || (ourVersion == maxVersion && ourRound < maxRound)) {
+                PEER_LOG("replacement found for element " << unsigned(element) << " from node " << bestNode);
+                SendDataRequest(localGroup.at(bestNode).address, element);
+            }
+            else {
+                PEER_LOG("replacement not found for element " << unsigned(element));
+                if(no_version) {
+                    elementInfo.set_round(InitialRound());
+                    stateGeneration++;
+                    PEER_LOG("initialized to " << unsigned(InitialRound()));
+                    PushUpdate(element, node_id, true);
+                }
+            }
+        }
+        else {
+            PEER_LOG("found " << unsigned(element) << " but, empty local group");
+            if(no_version) {
+                elementInfo.set_round(InitialRound());
+                stateGeneration++;
+                PEER_LOG("initialized to " << unsigned(InitialRound()));
+            }
+        }
+    }
+
+    // prunes the nodes from the local group that have not been responsive for heartbeatTimeout
+    void CheckHeartbeats(int64_t currentTime) {
+        SetTime(currentTime);
+        for(auto it = localGroup.begin(); it != localGroup.end();) {
+            if(currentTime - it->second.recentTime >= heartbeatTimeout) {
+                it = localGroup.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    // parses buf as an M and hands it to receive. false if it was too short to be one
+    template<typename M, typename F>
+    static bool Dispatch(const uint8_t *buf, size_t len, F receive) {
+        M m;
+        if(!M::deserialize(buf, len, &m)) {
+            return false;
+        }
+        receive(m);
+        return true;
+    }
+
+    // because of how we serialize, the first byte is the message type
+    void ReceiveMessage(const uint8_t *buf, size_t len, int64_t currentTime) {
+        SetTime(currentTime);
+        if(len == 0) {
+            PEER_LOG("INVALID MESSAGE");
+            return;
+        }
+        bool parsed = false;
+        switch(buf[0]) {
+        case ADVERT: parsed = Dispatch<ADVERT_Message>(buf, len, [&](const ADVERT_Message &m) { ReceiveAdvert(m, currentTime); }); break;
+        case ADVERT_PART: parsed = Dispatch<ADVERT_PART_Message>(buf, len, [&](const ADVERT_PART_Message &m) { ReceiveAdvertPart(m, currentTime); }); break;
+        case REQUEST_DATA: parsed = Dispatch<REQUEST_DATA_Message>(buf, len, [&](const REQUEST_DATA_Message &m) { ReceiveDataRequest(m, currentTime); }); break;
+        case SEND_DATA_CHUNK: parsed = Dispatch<SEND_DATA_CHUNK_Message>(buf, len, [&](const SEND_DATA_CHUNK_Message &m) { ReceiveDataChunk(m, currentTime); }); break;
+        case CHUNK_ACK: parsed = Dispatch<CHUNK_ACK_Message>(buf, len, [&](const CHUNK_ACK_Message &m) { ReceiveChunkACK(m); }); break;
+        case SEND_DATA: parsed = Dispatch<SEND_DATA_Message>(buf, len, [&](const SEND_DATA_Message &m) { ReceiveSendData(m); }); break;
+        case ACK: parsed = Dispatch<ACK_Message>(buf, len, [&](const ACK_Message &m) { ReceiveACK(m); }); break;
+        case REQUEST_CHUNKS: parsed = Dispatch<REQUEST_CHUNKS_Message>(buf, len, [&](const REQUEST_CHUNKS_Message &m) { ReceiveChunkRequest(m); }); break;
+        case SEND_CHUNK: parsed = Dispatch<SEND_CHUNK_Message>(buf, len, [&](const SEND_CHUNK_Message &m) { ReceiveChunk(m, currentTime); }); break;
+        case SYNC_DIGEST: parsed = Dispatch<SYNC_DIGEST_Message>(buf, len, [&](const SYNC_DIGEST_Message &m) { ReceiveSyncDigest(m); }); break;
+        case SYNC_DATA: parsed = Dispatch<SYNC_DATA_Message>(buf, len, [&](const SYNC_DATA_Message &m) { ReceiveSyncData(m); }); break;
+        case SYNC_ACK: parsed = Dispatch<SYNC_ACK_Message>(buf, len, [&](const SYNC_ACK_Message &m) { ReceiveSyncACK(m); }); break;
+        }
+        if(!parsed) {
+            PEER_LOG("INVALID MESSAGE");
+        }
+        if(recoveringSince >= 0) {
+            CheckRecovered();
+        }
+    }
+
+    // how many messages the next advertisement takes: one ADVERT if it fits, otherwise ADVERT_PARTs
+    size_t AdvertisementParts() {
+        size_t entries = GetOwnAdvertEntries().size() / PackedAdvertEntries::entrySize;
+        if(ADVERT_Message::headerSize + entries*PackedAdvertEntries::entrySize <= maxMessageSize) {
+            return 1;
+        }
+        size_t perPart = AdvertPartEntries();
+        return std::min<size_t>((entries + perPart - 1) / perPart, UINT8_MAX);
+    }
+
+    // the given part of the advertisement, 0 <= part < AdvertisementParts()
+    const std::vector<uint8_t>& BuildAdvertisement(uint32_t ownAddress, size_t part = 0) {
+        advertisedAddress = ownAddress;
+        const std::vector<uint8_t> &entries = GetOwnAdvertEntries();
+        size_t parts = AdvertisementParts();
+        if(parts == 1) {
+            txBuffer.clear();
+            txBuffer.push_back(ADVERT);
+            fourByteToOne(node_id, &txBuffer);
+            fourByteToOne(ownAddress, &txBuffer);
+            txBuffer.insert(txBuffer.end(), entries.begin(), entries.end());
+            return txBuffer;
+        }
+        size_t total = entries.size() / PackedAdvertEntries::entrySize;
+        size_t first = part * AdvertPartEntries();
+        size_t count = std::min(AdvertPartEntries(), total - std::min(first, total));
+        ADVERT_PART_Message::serialize(node_id, ownAddress, part, parts, entries.data() + first*PackedAdvertEntries::entrySize, count, &txBuffer);
+        return txBuffer;
+    }
+
+    // resends whatever chunks have gone unacknowledged for chunkRetryTimeout, and forgets transfers
+    // that have run out of retries or gone quiet
+    void CheckTransfers(int64_t currentTime) {
+        SetTime(currentTime);
+        for(auto it = outgoing.begin(); it != outgoing.end();) {
+            OutgoingTransfer &t = it->second;
+            if(currentTime - t.lastSent < chunkRetryTimeout) {
+                ++it;
+                continue;
+            }
+            if(t.retries >= maxChunkRetries) {
+                PEER_LOG("node " << node_id << " gave up sending element " << unsigned(it->first.second) << " to node " << it->first.first);
+                it = outgoing.erase(it);
+                continue;
+            }
+            t.retries++;
+            SendChunks(it->first.second, t, currentTime);
+            ++it;
+        }
+        for(auto it = incoming.begin(); it != incoming.end();) {
+            if(currentTime - it->second.lastHeard >= transferTimeout) {
+                it = incoming.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        RequestChunks(currentTime);
+    }
+
+    // brings the node back after it was switched off or out of reach. its neighbors, and any
+    // transfers it had going, are forgotten since they have moved on, but with keepState its
+    // elements, sync groups and payload chunks are kept, and it catches up on whatever changed
+    // while it was away through one digest exchange with a neighbor (see SYNC_DIGEST). without
+    // keepState it starts over as a new node would. either way it counts as recovering until it
+    // has heard a neighbor and no neighbor advertises a newer state of any element it is near
+    void Rejoin(int64_t currentTime, bool keepState = true) {
+        if(!keepState) {
+            Setup(node_id, transport, catalog);
+        }
+        SetTime(currentTime);
+        localGroup.clear();
+        outgoing.clear();
+        incoming.clear();
+        chunkStore.ResetRequests();
+        selfConfirmedEpoch = UINT32_MAX;
+        stateGeneration++;
+        catchingUp = keepState;
+        recoveringSince = currentTime;
+        lastDigest = INT64_MIN / 2;
+    }
+
+    // whether the node is still catching up after Rejoin, and how many milliseconds the last
+    // rejoin took to catch up (-1 if none has yet)
+    bool is_recovering() const { return recoveringSince >= 0; }
+    int64_t get_lastRecovery() const { return lastRecovery; }
+
+    // gives the elements up to another node, usually the edge that owns them under a new
+    // EdgePartition. our states of them go to it batched in SYNC_DATAs, as when answering a digest,
+    // and then this node forgets them, payload chunks and all. the receiver adopts them as it
+    // would any SEND_DATA
+    void HandOff(const std::vector<elementId_t> &elements, nodeId_t to, uint32_t address, int64_t currentTime) {
+        SetTime(currentTime);
+        syncElements.clear();
+        for(elementId_t element : elements) {
+            if(FindElement(element) != nullptr) {
+                syncElements.push_back(element);
+            }
+        }
+        std::sort(syncElements.begin(), syncElements.end());
+        SendStates(to, address, syncElements);
+
+        // the chunks go after the states that refer to them, each one once, since nobody else
+        // may have them to ask for
+        hashes.clear();
+        for(elementId_t element : syncElements) {
+            const std::vector<chunkHash_t> &payload = AgreementInformation_map.at(element).get_payload();
+            hashes.insert(hashes.end(), payload.begin(), payload.end());
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        for(chunkHash_t hash : hashes) {
+            const ChunkStore::Chunk *chunk = chunkStore.Find(hash);
+            if(chunk != nullptr && SEND_CHUNK_Message::headerSize + chunk->bytes.size() <= maxMessageSize) {
+                SEND_CHUNK_Message::serialize(node_id, hash, chunk->bytes, &txBuffer);
+                transport->SendTo(address, txBuffer);
+            }
+        }
+
+        for(elementId_t element : syncElements) {
+            for(chunkHash_t hash : AgreementInformation_map.at(element).get_payload()) {
+                chunkStore.Release(hash);
+            }
+            AgreementInformation_map.erase(element);
+        }
+        for(auto it = incoming.begin(); it != incoming.end();) {
+            if(std::binary_search(syncElements.begin(), syncElements.end(), it->first.second)) {
+                it = incoming.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        nowNearby.clear();
+        for(elementId_t element : nearbyElements) {
+            if(FindElement(element) != nullptr) {
+                nowNearby.push_back(element);
+            }
+        }
+        ApplyNearby();
+        stateGeneration++;
+    }
+
+    // this node writes new data for an element: a new version whose payload is data, which this
+    // node alone agrees on until the others pick it up. only the chunks that differ from what the
+    // other nodes already hold will have to travel.
+    //
+    // returns false and leaves the element as it was if the write cannot be made: the version is
+    // 8 bits on the wire and has run out, or a chunk of data hashes the same as different bytes we
+    // hold (or as another chunk of data), which would otherwise be taken for it
+    bool SetPayload(elementId_t element, const uint8_t *data, size_t len, int64_t currentTime) {
+        SetTime(currentTime);
+        AgreementInformation &elementInfo = GetElement(element);
+        if(elementInfo.get_version() == std::numeric_limits<causalNum_t>::max()) {
+            PEER_LOG("node " << node_id << " is out of versions for element " << unsigned(element));
+            return false;
+        }
+
+        pieces.clear();
+        SplitPayload(data, len, payloadChunkSize, maxMessageSize - SEND_CHUNK_Message::headerSize, &pieces);
+        hashes.clear();
+        for(size_t idx = 0; idx < pieces.size(); idx++) {
+            const uint8_t *bytes = data + pieces[idx].first;
+            size_t size = pieces[idx].second;
+            chunkHash_t hash = chunkDigest(bytes, size);
+            const ChunkStore::Chunk *held = chunkStore.Find(hash);
+            bool clash = held != nullptr && (held->bytes.size() != size || !std::equal(bytes, bytes + size, held->bytes.begin()));
+            for(size_t prev = 0; !clash && prev < idx; prev++) {
+                clash = hashes[prev] == hash && (pieces[prev].second != size || std::memcmp(data + pieces[prev].first, bytes, size) != 0);
+            }
+            if(clash) {
+                PEER_LOG("node " << node_id << " has a chunk hash collision writing element " << unsigned(element));
+                return false;
+            }
+            hashes.push_back(hash);
+        }
+
+        elementInfo.set_version(elementInfo.get_version()+1);
+        elementInfo.set_round(InitialRound());
+        elementInfo.set_agreeingNodes(PackedMembers(), epoch);
+        elementInfo.add_agreeingNodes(node_id, epoch);
+        for(size_t idx = 0; idx < pieces.size(); idx++) {
+            chunkStore.Retain(hashes[idx], element, node_id);
+            chunkStore.Fill(hashes[idx], data + pieces[idx].first, pieces[idx].second);
+        }
+        for(chunkHash_t hash : elementInfo.get_payload()) {
+            chunkStore.Release(hash);
+        }
+        elementInfo.set_payload(hashes);
+        stateGeneration++;
+        PushUpdate(element, node_id, true);
+        return true;
+    }
+
+    // the payload of our state of the element. false if we do not know the element or are still
+    // missing some of its chunks
+    bool GetPayload(elementId_t element, std::vector<uint8_t> *out) const {
+        out->clear();
+        auto it = AgreementInformation_map.find(element);
+        if(it == AgreementInformation_map.end()) {
+            return false;
+        }
+        for(chunkHash_t hash : it->second.get_payload()) {
+            const ChunkStore::Chunk *chunk = chunkStore.Find(hash);
+            if(chunk == nullptr) {
+                return false;
+            }
+            out->insert(out->end(), chunk->bytes.begin(), chunk->bytes.end());
+        }
+        return true;
+    }
+
+    nodeId_t get_nodeId() const { return node_id; }
+    const ElementCatalog& get_catalog() const { return *catalog; }
+    const std::map<elementId_t, AgreementInformation>& get_AgreementInformation() const { return AgreementInformation_map; }
+    const std::vector<elementId_t>& get_nearbyElements() const { return nearbyElements; }
+    const std::map<nodeId_t, nodeEntry>& get_localGroup() const { return localGroup; }
+    const ChunkStore& get_chunkStore() const { return chunkStore; }
+
+    uint32_t get_epoch() const { return epoch; }
+
+    /* FORMAT of a saved state. times are kept relative to when it was saved, so it can be loaded
+     * into a run whose clock starts over
+     * |32 bit node id|32 bit element count|
+     * then per element:
+     * |16 bit element|8 bit version|8 bit round|32 bit x|32 bit y|32 bit member count|
+     * |32 bit member|8 bit age in sync epochs|... (as in SEND_DATA)
+     * |32 bit chunk count|64 bit hash|...
+     * |32 bit nearby count|16 bit element|...
+     * |32 bit neighbor count|
+     * then per neighbor:
+     * |32 bit node id|32 bit address|32 bit ms since last heard|32 bit advert length|advert entries|
+     * |32 bit held chunk count|
+     * then per chunk held:
+     * |64 bit hash|32 bit length|bytes|
+     *
+     * chunked transfers in flight are not saved; they are retried from scratch after a load, as are
+     * requests for missing chunks
+     */
+    void SaveState(int64_t currentTime, std::vector<uint8_t> *out) const {
+        uint32_t at = (uint32_t)(currentTime / syncEpochLength);
+        out->clear();
+        fourByteToOne(node_id, out);
+        fourByteToOne(AgreementInformation_map.size(), out);
+        for(const auto &elem : AgreementInformation_map) {
+            twoByteToOne(elem.first, out);
+            out->push_back(elem.second.get_version());
+            out->push_back(elem.second.get_round());
+            uint32_t x, y;
+            std::memcpy(&x, &elem.second.get_fineLocation().first, 4);
+            std::memcpy(&y, &elem.second.get_fineLocation().second, 4);
+            fourByteToOne(x, out);
+            fourByteToOne(y, out);
+            fourByteToOne(elem.second.get_agreeingNodes().size(at), out);
+            elem.second.get_agreeingNodes().forEach(at, [out](nodeId_t nodeId, uint8_t age) {
+                fourByteToOne(nodeId, out);
+                out->push_back(age);
+            });
+            fourByteToOne(elem.second.get_payload().size(), out);
+            for(chunkHash_t hash : elem.second.get_payload()) {
+                eightByteToOne(hash, out);
+            }
+        }
+        fourByteToOne(nearbyElements.size(), out);
+        for(elementId_t element : nearbyElements) {
+            twoByteToOne(element, out);
+        }
+        fourByteToOne(localGroup.size(), out);
+        for(const auto &node : localGroup) {
+            fourByteToOne(node.first, out);
+            fourByteToOne(node.second.address, out);
+            fourByteToOne((uint32_t)std::max<int64_t>(currentTime - node.second.recentTime, 0), out);
+            fourByteToOne(node.second.advertEntries.size(), out);
+            out->insert(out->end(), node.second.advertEntries.begin(), node.second.advertEntries.end());
+        }
+        fourByteToOne(chunkStore.held(), out);
+        for(const auto &chunk : chunkStore.get_chunks()) {
+            if(chunk.second.present) {
+                eightByteToOne(chunk.first, out);
+                fourByteToOne(chunk.second.bytes.size(), out);
+                out->insert(out->end(), chunk.second.bytes.begin(), chunk.second.bytes.end());
+            }
+        }
+    }
+
+    // replaces this node's state with one written by SaveState, as of currentTime. returns false,
+    // leaving the node empty, if the state is for another node, does not parse, or lists a nearby
+    // element it holds no state for
+    bool LoadState(const uint8_t *buf, size_t len, int64_t currentTime) {
+        Setup(node_id, transport, catalog);
+        SetTime(currentTime);
+        stateGeneration++;
+        selfConfirmedEpoch = UINT32_MAX;
+
+        size_t pos = 0;
+        auto has = [&](size_t bytes) { return len - pos >= bytes; };
+        auto four = [&]() { uint32_t v = oneByteToFour(buf + pos); pos += 4; return v; };
+        auto two = [&]() { uint16_t v = oneByteToTwo(buf + pos); pos += 2; return v; };
+
+        if(!has(8) || four() != node_id) {
+            return false;
+        }
+        uint32_t elements = four();
+        for(uint32_t i = 0; i < elements; i++) {
+            if(!has(16)) {
+                return Reject();
+            }
+            elementId_t element = two();
+            causalNum_t version = buf[pos++];
+            causalNum_t round = buf[pos++];
+            uint32_t x = four(), y = four();
+            uint32_t members = four();
+            if(element >= catalog->size() || !has((size_t)members * PackedMembers::memberSize)) {
+                return Reject();
+            }
+            std::pair<location_t, location_t> location;
+            std::memcpy(&location.first, &x, 4);
+            std::memcpy(&location.second, &y, 4);
+            AgreementInformation &elementInfo = AgreementInformation_map.emplace(element, AgreementInformation(location, node_id, epoch, syncHorizon)).first->second;
+            elementInfo.set_version(version);
+            elementInfo.set_round(round);
+            elementInfo.set_agreeingNodes(PackedMembers(buf + pos, members), epoch);
+            pos += (size_t)members * PackedMembers::memberSize;
+
+            if(!has(4)) {
+                return Reject();
+            }
+            uint32_t chunks = four();
+            if(!has((size_t)chunks * PackedHashes::hashSize)) {
+                return Reject();
+            }
+            AdoptPayload(element, elementInfo, PackedHashes(buf + pos, chunks), node_id);
+            pos += (size_t)chunks * PackedHashes::hashSize;
+        }
+
+        if(!has(4)) {
+            return Reject();
+        }
+        uint32_t nearby = four();
+        if(!has((size_t)nearby * 2)) {
+            return Reject();
+        }
+        // every nearby element must have come with its state, since the rest of the node looks
+        // it up with .at(); see UpdateNearbyElements
+        for(uint32_t i = 0; i < nearby; i++) {
+            elementId_t element = two();
+            if((!nearbyElements.empty() && element <= nearbyElements.back()) || AgreementInformation_map.count(element) == 0) {
+                return Reject();
+            }
+            nearbyElements.push_back(element);
+        }
+        nearbyKnown = true;
+
+        if(!has(4)) {
+            return Reject();
+        }
+        uint32_t neighbors = four();
+        for(uint32_t i = 0; i < neighbors; i++) {
+            if(!has(16)) {
+                return Reject();
+            }
+            nodeId_t id = four();
+            uint32_t address = four();
+            uint32_t age = four();
+            uint32_t advertBytes = four();
+            if(!has(advertBytes) || advertBytes % PackedAdvertEntries::entrySize != 0) {
+                return Reject();
+            }
+            nodeEntry &thisNode = localGroup.emplace(id, nodeEntry(address, currentTime - age)).first->second;
+            thisNode.advertEntries.assign(buf + pos, buf + pos + advertBytes);
+            thisNode.advertSorted = thisNode.get_advert().is_sorted();
+            pos += advertBytes;
+        }
+
+        if(!has(4)) {
+            return Reject();
+        }
+        uint32_t chunks = four();
+        for(uint32_t i = 0; i < chunks; i++) {
+            if(!has(12)) {
+                return Reject();
+            }
+            chunkHash_t hash = oneByteToEight(buf + pos);
+            pos += 8;
+            uint32_t bytes = four();
+            if(!has(bytes) || !chunkStore.Fill(hash, buf + pos, bytes)) {
+                return Reject();
+            }
+            pos += bytes;
+        }
+        if(pos != len) {
+            return Reject();
+        }
+        return true;
+    }
+
+private:
+    bool Reject() {
+        Setup(node_id, transport, catalog);
+        return false;
+    }
+
+    void SetTime(int64_t currentTime) {
+        now = currentTime;
+        epoch = (uint32_t)(currentTime / syncEpochLength);
+    }
+
+    // the state for an element, created from the catalog the first time this node encounters it
+    AgreementInformation& GetElement(elementId_t element) {
+        auto it = AgreementInformation_map.find(element);
+        if(it == AgreementInformation_map.end()) {
+            std::pair<location_t, location_t> location = catalog->get_baseLocation(element);
+            if(locationNoise) {
+                location.first += locationNoise();
+                location.second += locationNoise();
+            }
+            it = AgreementInformation_map.emplace(element, AgreementInformation(location, node_id, epoch, syncHorizon)).first;
+        }
+        return it->second;
+    }
+
+    // the round a node starts an agreement at, different per node so that nodes starting the same
+    // element apart are told apart. round 0 means no agreement yet and rounds are 8 bits, so ids
+    // wrap onto 1..255 and nodes whose ids are 255 apart start at the same round
+    causalNum_t InitialRound() const {
+        return (causalNum_t)(node_id % std::numeric_limits<causalNum_t>::max() + 1);
+    }
+
+    AgreementInformation* FindElement(elementId_t element) {
+        auto it = AgreementInformation_map.find(element);
+        return it == AgreementInformation_map.end() ? nullptr : &it->second;
+    }
+
+    // our own advert entries, rebuilt only when our state has changed since the last call
+    const std::vector<uint8_t>& GetOwnAdvertEntries() {
+        if(ownAdvertGeneration != stateGeneration) {
+            ownAdvert.clear();
+            ADVERT_Message::serializeEntries(nearbyElements, AgreementInformation_map, &ownAdvert);
+            ownAdvertGeneration = stateGeneration;
+        }
+        return ownAdvert;
+    }
+
+    size_t AdvertPartEntries() const {
+        return (maxMessageSize - ADVERT_PART_Message::headerSize) / PackedAdvertEntries::entrySize;
+    }
+
+    // starts agreement on the elements in nowNearby that were not nearby before, then makes nowNearby
+    // the nearby set
+    void ApplyNearby() {
+        if(nowNearby != nearbyElements) {
+            stateGeneration++;
+        }
+
+        for(elementId_t element : nowNearby) {
+            if(!std::binary_search(nearbyElements.begin(), nearbyElements.end(), element)) {
+                BeginAgreement(element);
+            }
+        }
+        nearbyElements.swap(nowNearby);
+        nearbyKnown = true;
+
+        // this node holds every nearby element it knows, so it stays in their sync groups
+        if(selfConfirmedEpoch != epoch) {
+            selfConfirmedEpoch = epoch;
+            for(elementId_t element : nearbyElements) {
+                AgreementInformation *elementInfo = FindElement(element);
+                if(elementInfo != nullptr) {
+                    elementInfo->add_agreeingNodes(node_id, epoch);
+                }
+            }
+        }
+    }
+
+    bool IsNearby(elementId_t element) const {
+        return std::binary_search(nearbyElements.begin(), nearbyElements.end(), element);
+    }
+
+    // the neighbor's record is updated in place; only a node we have never heard from costs an allocation
+    nodeEntry& Heard(nodeId_t id, uint32_t address, int64_t currentTime) {
+        auto entry = localGroup.find(id);
+        if(entry == localGroup.end()) {
+            entry = localGroup.emplace(id, nodeEntry(address, currentTime)).first;
+        }
+        entry->second.address = address;
+        entry->second.recentTime = currentTime;
+        return entry->second;
+    }
+
+    void ReceiveAdvert(const ADVERT_Message &info, int64_t currentTime) {
+        CompareAdvert(info.senderId, Heard(info.senderId, info.ipv4Address, currentTime), info.entries);
+    }
+
+    void ReceiveAdvertPart(const ADVERT_PART_Message &info, int64_t currentTime) {
+        nodeEntry &thisNode = Heard(info.senderId, info.ipv4Address, currentTime);
+        size_t bytes = info.entries.size() * PackedAdvertEntries::entrySize;
+        if(info.part == 0) {
+            thisNode.pendingAdvert.assign(info.entries.bytes(), info.entries.bytes() + bytes);
+            thisNode.pendingPart = 1;
+        }
+        else if(info.part == thisNode.pendingPart) {
+            thisNode.pendingAdvert.insert(thisNode.pendingAdvert.end(), info.entries.bytes(), info.entries.bytes() + bytes);
+            thisNode.pendingPart++;
+        }
+        else {
+            // a part went missing; wait for the next beacon
+            thisNode.pendingPart = 0;
+            return;
+        }
+        if(thisNode.pendingPart == info.parts) {
+            thisNode.pendingPart = 0;
+            CompareAdvert(info.senderId, thisNode, PackedAdvertEntries(thisNode.pendingAdvert.data(), thisNode.pendingAdvert.size() / PackedAdvertEntries::entrySize));
+        }
+    }
+
+    void CompareAdvert(nodeId_t senderId, nodeEntry &thisNode, const PackedAdvertEntries &entries) {
+        // in a converged group almost every beacon repeats the last one and our own state has not
+        // moved since we compared against it, so there is nothing to decode. a neighbor that was
+        // ahead of us last time is always re-checked so that a lost REQUEST_DATA gets retried.
+        // the repeat is spotted against the entries kept from last time, size first and then memcmp
+        const uint8_t *raw = entries.bytes();
+        size_t rawSize = entries.size() * PackedAdvertEntries::entrySize;
+        if(thisNode.comparedGeneration == stateGeneration && !thisNode.aheadOfUs && thisNode.confirmedEpoch == epoch
+            && rawSize == thisNode.advertEntries.size() && (rawSize == 0 || std::memcmp(raw, thisNode.advertEntries.data(), rawSize) == 0)) {
+            return;
+        }
+
+        // keep the raw entries; they are decoded lazily by BeginAgreement
+        thisNode.advertEntries.assign(raw, raw + rawSize);
+        thisNode.advertSorted = entries.is_sorted();
+        thisNode.comparedGeneration = stateGeneration;
+
+        // only the entries that beat our own state are pulled out. a neighbor near the same elements
+        // as us advertises them in the same order we would, so that prefix is compared in bulk
+        // against our own advert; whatever is left after the first differing element is checked one by one
+        agree.clear();
+        const std::vector<uint8_t> &ours = GetOwnAdvertEntries();
+        size_t common = std::min(entries.size(), ours.size() / PackedAdvertEntries::entrySize);
+        size_t matched = CompareAdvertEntries(raw, ours.data(), common, &agree);
+        for(size_t idx = matched; idx < entries.size(); idx++) {
+            elementId_t element = entries.element(idx);
+            // nearby elements always have state, see UpdateNearbyElements
+            if(!IsNearby(element)) {
+                continue;
+            }
+            causalNum_t theirVersion = entries.version(idx);
+            causalNum_t theirRound = entries.round(idx);
+
+            const AgreementInformation &ours = AgreementInformation_map.at(element);
+            causalNum_t ourVersion = ours.get_version();
+            causalNum_t ourRound = ours.get_round();
+            if(theirVersion > ourVersion || (theirVersion == ourVersion && theirRound > ourRound)) {
+                PEER_LOG("node " << node_id << " saw " << senderId << ", a better node for nearby element " << unsigned(element));
+                agree.push_back(element);
+            }
+        }
+        thisNode.aheadOfUs = !agree.empty();
+
+        // once an epoch, a neighbor that advertises the same version and round as us is
+        // confirmed in the sync groups it already belongs to, so it does not age out while in range
+        if(thisNode.confirmedEpoch != epoch) {
+            thisNode.confirmedEpoch = epoch;
+            for(size_t idx = 0; idx < entries.size(); idx++) {
+                AgreementInformation *ours = IsNearby(entries.element(idx)) ? FindElement(entries.element(idx)) : nullptr;
+                if(ours != nullptr && ours->get_version() == entries.version(idx) && ours->get_round() == entries.round(idx)) {
+                    ours->refresh_agreeingNodes(senderId, epoch);
+                }
+            }
+        }
+
+        // fresh from a rejoin, everything this neighbor has newer comes in one exchange. a digest
+        // still unanswered after chunkRetryTimeout goes again, to whichever neighbor is ahead next
+        if(catchingUp && !agree.empty()) {
+            if(now - lastDigest < chunkRetryTimeout) {
+                return;
+            }
+            lastDigest = now;
+            PEER_LOG("node " << node_id << " catches up on " << agree.size() << " elements from node " << senderId);
+            SYNC_DIGEST_Message::serialize(node_id, advertisedAddress, agree, AgreementInformation_map, &txBuffer);
+            transport->SendTo(thisNode.address, txBuffer);
+            return;
+        }
+        for(elementId_t elem : agree) {
+            BeginAgreement(elem);
+        }
+    }
+
+    // answers a SYNC_DIGEST with every state we hold that is newer than the one in it
+    void ReceiveSyncDigest(const SYNC_DIGEST_Message &info) {
+        syncElements.clear();
+        for(size_t idx = 0; idx < info.entries.size(); idx++) {
+            elementId_t element = info.entries.element(idx);
+            AgreementInformation *elementInfo = FindElement(element);
+            if(elementInfo != nullptr && causalKey(elementInfo->get_version(), elementInfo->get_round()) > causalKey(info.entries.version(idx), info.entries.round(idx))) {
+                syncElements.push_back(element);
+            }
+        }
+        SendStates(info.senderId, info.ipv4Address, syncElements);
+    }
+
+    // sends our states of the elements, as many to a SYNC_DATA as fit
+    void SendStates(nodeId_t to, uint32_t address, const std::vector<elementId_t> &elements) {
+        syncBuffer.clear();
+        for(elementId_t element : elements) {
+            AgreementInformation &elementInfo = AgreementInformation_map.at(element);
+            elementInfo.add_agreeingNodes(node_id, epoch);
+            SEND_DATA_Message::serialize(node_id, element, elementInfo, epoch, &txBuffer);
+            if(SYNC_DATA_Message::headerSize + 2 + txBuffer.size() > maxMessageSize) {
+                // too big to share a datagram with anything; it goes on its own, in chunks
+                SendData(to, address, element, now);
+                continue;
+            }
+            if(syncBuffer.size() + 2 + txBuffer.size() > maxMessageSize) {
+                transport->SendTo(address, syncBuffer);
+                syncBuffer.clear();
+            }
+            if(syncBuffer.empty()) {
+                syncBuffer.push_back(SYNC_DATA);
+                fourByteToOne(node_id, &syncBuffer);
+            }
+            twoByteToOne(txBuffer.size(), &syncBuffer);
+            syncBuffer.insert(syncBuffer.end(), txBuffer.begin(), txBuffer.end());
+        }
+        if(!syncBuffer.empty()) {
+            transport->SendTo(address, syncBuffer);
+        }
+    }
+
+    void ReceiveSyncData(const SYNC_DATA_Message &info) {
+        syncAcks.clear();
+        info.forEach([this](const uint8_t *buf, size_t len) {
+            SEND_DATA_Message m;
+            if(SEND_DATA_Message::deserialize(buf, len, &m)) {
+                ReceiveSendData(m, &syncAcks);
+            }
+        });
+        auto sender = localGroup.find(info.senderId);
+        if(!syncAcks.empty() && sender != localGroup.end()) {
+            SYNC_ACK_Message::serialize(node_id, syncAcks, &txBuffer);
+            transport->SendTo(sender->second.address, txBuffer);
+        }
+    }
+
+    void ReceiveSyncACK(const SYNC_ACK_Message &info) {
+        for(size_t idx = 0; idx < info.count; idx++) {
+            ReceiveACK(ACK_Message(info.senderId, info.element(idx)));
+        }
+    }
+
+    // ends a recovery once we know what we are near, have a whole advert from some neighbor, and no
+    // neighbor advertises anything newer than what we hold of the elements we are near
+    void CheckRecovered() {
+        if(!nearbyKnown) {
+            return;
+        }
+        bool heardAdvert = false;
+        for(const auto &node : localGroup) {
+            heardAdvert = heardAdvert || node.second.comparedGeneration != UINT32_MAX;
+            PackedAdvertEntries advert = node.second.get_advert();
+            for(size_t idx = 0; idx < advert.size(); idx++) {
+                if(!IsNearby(advert.element(idx))) {
+                    continue;
+                }
+                const AgreementInformation &ours = AgreementInformation_map.at(advert.element(idx));
+                if(causalKey(advert.version(idx), advert.round(idx)) > causalKey(ours.get_version(), ours.get_round())) {
+                    return;
+                }
+            }
+        }
+        if(!heardAdvert) {
+            return;
+        }
+        lastRecovery = now - recoveringSince;
+        recoveringSince = -1;
+        catchingUp = false;
+        PEER_LOG("node " << node_id << " caught up " << lastRecovery << " ms after rejoining");
+    }
+
+    void ReceiveDataRequest(const REQUEST_DATA_Message &info, int64_t currentTime) {
+        // we cannot serve an element we have never encountered, or answer a node whose beacons we
+        // have not heard (on a lossy link the requester can hear us without us hearing it)
+        auto sender = localGroup.find(info.senderId);
+        if(FindElement(info.elementId) == nullptr || sender == localGroup.end()) {
+            return;
+        }
+        SendData(info.senderId, sender->second.address, info.elementId, currentTime);
+    }
+
+    void ReceiveDataChunk(const SEND_DATA_CHUNK_Message &info, int64_t currentTime) {
+        // total comes off the wire, so nothing is set aside for it until we know the sender and the
+        // transfer is no bigger than its chunks could carry
+        auto sender = localGroup.find(info.senderId);
+        if(sender == localGroup.end() || info.chunks == 0 || info.chunk >= info.chunks) {
+            return;
+        }
+        if(maxMessageSize <= SEND_DATA_CHUNK_Message::headerSize || info.total > (size_t)info.chunks * (maxMessageSize - SEND_DATA_CHUNK_Message::headerSize)) {
+            return;
+        }
+        size_t chunkSize = SEND_DATA_CHUNK_Message::ChunkSize(info.total, info.chunks);
+        size_t begin = info.chunk * chunkSize;
+        if(begin + info.payloadSize > info.total) {
+            return;
+        }
+
+        // a different transfer id means the sender's state moved on, so whatever we had is stale
+        IncomingTransfer &t = incoming[std::pair<nodeId_t, elementId_t>(info.senderId, info.elementId)];
+        if(t.transferId != info.transferId || t.total != info.total || t.chunks != info.chunks || t.whole.empty()) {
+            t.transferId = info.transferId;
+            t.total = info.total;
+            t.chunks = info.chunks;
+            t.whole.assign(info.total, 0);
+            t.bitmap.assign((info.chunks + 7) / 8, 0);
+            t.received = 0;
+        }
+        t.lastHeard = currentTime;
+
+        bool complete = t.received == t.chunks;
+        if(!((t.bitmap[info.chunk / 8] >> (info.chunk % 8)) & 1)) {
+            std::copy(info.payload, info.payload + info.payloadSize, t.whole.begin() + begin);
+            t.bitmap[info.chunk / 8] |= (uint8_t)(1 << (info.chunk % 8));
+            t.received++;
+        }
+
+        CHUNK_ACK_Message::serialize(node_id, info.elementId, t.transferId, t.chunks, t.bitmap, &txBuffer);
+        transport->SendTo(sender->second.address, txBuffer);
+
+        SEND_DATA_Message m;
+        if(!complete && t.received == t.chunks && !t.whole.empty() && t.whole[0] == SEND_DATA
+            && SEND_DATA_Message::deserialize(t.whole.data(), t.whole.size(), &m)) {
+            ReceiveSendData(m);
+        }
+    }
+
+    void ReceiveChunkACK(const CHUNK_ACK_Message &info) {
+        auto it = outgoing.find(std::pair<nodeId_t, elementId_t>(info.senderId, info.elementId));
+        if(it == outgoing.end() || it->second.transferId != info.transferId) {
+            return;
+        }
+        OutgoingTransfer &t = it->second;
+        bool done = true;
+        for(uint16_t chunk = 0; chunk < t.chunks; chunk++) {
+            if(info.has(chunk)) {
+                t.acked[chunk] = true;
+            }
+            done = done && t.acked[chunk];
+        }
+        if(done) {
+            outgoing.erase(it);
+        }
+    }
+
+    // acknowledges the state straight away, or leaves the element in acks for the caller to
+    // acknowledge together with others
+    void ReceiveSendData(const SEND_DATA_Message &info, std::vector<elementId_t> *acks = nullptr) {
+        if(info.elementId >= catalog->size()) {
+            return;
+        }
+        AgreementInformation &elementInfo = GetElement(info.elementId);
+
+        // SEND_DATA is only ever sent to a node that looked behind, so one that is not newer than
+        // our state crossed it on the way here: a push overtaken by another, or an answer to a
+        // request that someone else already answered. never step back to it, and do not take an
+        // equal one either. joining its sync group would move our round past it and set off
+        // another push, and two such states crossing would echo back and forth
+        causalKey_t before = causalKey(elementInfo.get_version(), elementInfo.get_round());
+        if(causalKey(info.version, info.round) <= before) {
+            return;
+        }
+
+        // read our membership off the wire before the sync group is overwritten
+        bool wasMember = info.sync_group.contains(node_id);
+        elementInfo.set_version(info.version);
+        elementInfo.set_round(info.round);
+        if(!wasMember) {
+            elementInfo.set_round(elementInfo.get_round()+1);
+        }
+        elementInfo.set_agreeingNodes(info.sync_group, epoch);
+        elementInfo.add_agreeingNodes(node_id, epoch);
+        elementInfo.refresh_agreeingNodes(info.senderId, epoch);
+        elementInfo.set_fineLocation(info.xpos, info.ypos);
+        if(AdoptPayload(info.elementId, elementInfo, info.payload, info.senderId)) {
+            RequestChunks(now);
+        }
+        stateGeneration++;
+
+        auto sender = localGroup.find(info.senderId);
+        if(acks != nullptr) {
+            acks->push_back(info.elementId);
+        }
+        else if(sender != localGroup.end()) {
+            SendACK(sender->second.address, info.elementId);
+        }
+
+        if(causalKey(elementInfo.get_version(), elementInfo.get_round()) > before) {
+            PushUpdate(info.elementId, info.senderId, false);
+        }
+    }
+
+    void ReceiveACK(const ACK_Message &info) {
+        AgreementInformation *elementInfo = FindElement(info.elementId);
+        if(elementInfo == nullptr) {
+            return;
+        }
+        bool joined = elementInfo->add_agreeingNodes(info.senderId, epoch);
+        if(joined) {
+            elementInfo->set_round(elementInfo->get_round()+1);
+            stateGeneration++;
+            PushUpdate(info.elementId, info.senderId, true);
+        }
+    }
+
+    // sends our state of the element to up to pushFanout neighbors that advertised an older one,
+    // see pushFanout. from is the node we got the state from, and originated says whether this
+    // node made the state itself rather than adopting it
+    void PushUpdate(elementId_t element, nodeId_t from, bool originated) {
+        if(pushFanout == 0) {
+            return;
+        }
+        if(!originated && pushRandom && pushRandom() >= pushForwardProbability) {
+            return;
+        }
+        const AgreementInformation &elementInfo = AgreementInformation_map.at(element);
+        causalKey_t ours = causalKey(elementInfo.get_version(), elementInfo.get_round());
+        pushTargets.clear();
+        for(const auto &node : localGroup) {
+            if(node.first == from) {
+                continue;
+            }
+            PackedAdvertEntries advert = node.second.get_advert();
+            size_t idx = advert.find(element);
+            if(idx != advert.size() && causalKey(advert.version(idx), advert.round(idx)) < ours) {
+                pushTargets.push_back(node.first);
+            }
+        }
+
+        // a partial shuffle picks the fanout uniformly from the neighbors that are behind
+        size_t count = std::min<size_t>(pushFanout, pushTargets.size());
+        for(size_t i = 0; i < count; i++) {
+            if(pushRandom) {
+                size_t j = std::min(i + (size_t)(pushRandom() * (pushTargets.size() - i)), pushTargets.size() - 1);
+                std::swap(pushTargets[i], pushTargets[j]);
+            }
+            PEER_LOG("node " << node_id << " pushes element " << unsigned(element) << " to node " << pushTargets[i]);
+            SendData(pushTargets[i], localGroup.at(pushTargets[i]).address, element, now);
+        }
+    }
+
+    // makes hashes the element's payload, keeping the chunks it shares with the old one. returns
+    // true if any of its chunks are missing
+    bool AdoptPayload(elementId_t element, AgreementInformation &elementInfo, const PackedHashes &hashes, nodeId_t source) {
+        const std::vector<chunkHash_t> &old = elementInfo.get_payload();
+        bool same = old.size() == hashes.size();
+        for(size_t idx = 0; same && idx < hashes.size(); idx++) {
+            same = old[idx] == hashes.hash(idx);
+        }
+        if(same) {
+            return false;
+        }
+        // take the new references before dropping the old, so shared chunks are never let go
+        for(size_t idx = 0; idx < hashes.size(); idx++) {
+            chunkStore.Retain(hashes.hash(idx), element, source);
+        }
+        for(chunkHash_t hash : old) {
+            chunkStore.Release(hash);
+        }
+        elementInfo.set_payload(hashes);
+        return !chunkStore.get_missing().empty();
+    }
+
+    // asks for the missing chunks that are due, up to maxChunksInFlight outstanding. a chunk is
+    // first asked of the node we heard of it from, and after that of the neighbors advertising
+    // the version of its element we hold, in turn
+    void RequestChunks(int64_t currentTime) {
+        if(chunkStore.get_missing().empty()) {
+            return;
+        }
+        uint32_t inFlight = 0;
+        chunksSinceRequest = 0;
+        chunkRequests.clear();
+        for(chunkHash_t hash : chunkStore.get_missing()) {
+            ChunkStore::Chunk &chunk = chunkStore.at(hash);
+            if(chunk.requests > 0 && currentTime - chunk.requestedAt < chunkRetryTimeout) {
+                inFlight++;
+            }
+        }
+        for(chunkHash_t hash : chunkStore.get_missing()) {
+            if(inFlight >= maxChunksInFlight) {
+                break;
+            }
+            ChunkStore::Chunk &chunk = chunkStore.at(hash);
+            if(chunk.requests > 0 && currentTime - chunk.requestedAt < ((int64_t)chunkRetryTimeout << std::min<uint32_t>(chunk.requests - 1, 5))) {
+                continue;
+            }
+            nodeId_t holder = chunk.source;
+            if(chunk.requests > 0 || localGroup.count(holder) == 0) {
+                const AgreementInformation *elementInfo = FindElement(chunk.element);
+                chunkHolders.clear();
+                for(const auto &node : localGroup) {
+                    PackedAdvertEntries advert = node.second.get_advert();
+                    size_t idx = advert.find(chunk.element);
+                    if(elementInfo != nullptr && idx != advert.size() && advert.version(idx) == elementInfo->get_version()) {
+                        chunkHolders.push_back(node.first);
+                    }
+                }
+                if(chunkHolders.empty()) {
+                    continue;
+                }
+                holder = chunkHolders[chunk.requests % chunkHolders.size()];
+            }
+            chunk.requestedAt = currentTime;
+            chunk.requests++;
+            inFlight++;
+            chunkRequests[holder].push_back(hash);
+        }
+
+        size_t perRequest = (maxMessageSize - REQUEST_CHUNKS_Message::headerSize) / PackedHashes::hashSize;
+        for(auto &request : chunkRequests) {
+            uint32_t address = localGroup.at(request.first).address;
+            for(size_t first = 0; first < request.second.size(); first += perRequest) {
+                hashes.assign(request.second.begin() + first, request.second.begin() + std::min(first + perRequest, request.second.size()));
+                REQUEST_CHUNKS_Message::serialize(node_id, hashes, &txBuffer);
+                transport->SendTo(address, txBuffer);
+            }
+        }
+    }
+
+    void ReceiveChunkRequest(const REQUEST_CHUNKS_Message &info) {
+        auto sender = localGroup.find(info.senderId);
+        if(sender == localGroup.end()) {
+            return;
+        }
+        for(size_t idx = 0; idx < info.hashes.size(); idx++) {
+            const ChunkStore::Chunk *chunk = chunkStore.Find(info.hashes.hash(idx));
+            if(chunk != nullptr && SEND_CHUNK_Message::headerSize + chunk->bytes.size() <= maxMessageSize) {
+                SEND_CHUNK_Message::serialize(node_id, info.hashes.hash(idx), chunk->bytes, &txBuffer);
+                transport->SendTo(sender->second.address, txBuffer);
+            }
+        }
+    }
+
+    void ReceiveChunk(const SEND_CHUNK_Message &info, int64_t currentTime) {
+        // keep the pipeline full: ask for more once half a window's worth has come in
+        if(chunkStore.Fill(info.hash, info.bytes, info.size) && ++chunksSinceRequest >= maxChunksInFlight / 2) {
+            RequestChunks(currentTime);
+        }
+    }
+
+    void SendDataRequest(uint32_t address, elementId_t elementId) {
+        REQUEST_DATA_Message(node_id, elementId).serialize(&txBuffer);
+        transport->SendTo(address, txBuffer);
+    }
+
+    void SendData(nodeId_t to, uint32_t address, elementId_t elementId, int64_t currentTime) {
+        AgreementInformation &elementInfo = AgreementInformation_map.at(elementId);
+        elementInfo.add_agreeingNodes(node_id, epoch);
+        SEND_DATA_Message::serialize(node_id, elementId, elementInfo, epoch, &txBuffer);
+        if(txBuffer.size() <= maxMessageSize) {
+            transport->SendTo(address, txBuffer);
+            return;
+        }
+
+        // too big for one datagram. if this exact state is already on its way to them, the
+        // request was a retry: carry on with the chunks they are missing rather than restarting
+        uint32_t transferId = (uint32_t)digestBytes(txBuffer.data(), txBuffer.size());
+        std::pair<nodeId_t, elementId_t> key(to, elementId);
+        auto it = outgoing.find(key);
+        if(it == outgoing.end() || it->second.transferId != transferId) {
+            size_t payload = maxMessageSize - SEND_DATA_CHUNK_Message::headerSize;
+            OutgoingTransfer t;
+            t.address = address;
+            t.transferId = transferId;
+            t.whole = txBuffer;
+            t.chunks = (uint16_t)std::min<size_t>((txBuffer.size() + payload - 1) / payload, UINT16_MAX);
+            t.acked.assign(t.chunks, false);
+            t.retries = 0;
+            it = outgoing.insert_or_assign(key, std::move(t)).first;
+        }
+        it->second.address = address;
+        it->second.retries = 0;
+        SendChunks(elementId, it->second, currentTime);
+    }
+
+    void SendChunks(elementId_t elementId, OutgoingTransfer &t, int64_t currentTime) {
+        for(uint16_t chunk = 0; chunk < t.chunks; chunk++) {
+            if(!t.acked[chunk]) {
+                SEND_DATA_CHUNK_Message::serialize(node_id, elementId, t.transferId, t.whole, chunk, t.chunks, &txBuffer);
+                transport->SendTo(t.address, txBuffer);
+            }
+        }
+        t.lastSent = currentTime;
+    }
+
+    void SendACK(uint32_t address, elementId_t elementId) {
+        ACK_Message(node_id, elementId).serialize(&txBuffer);
+        transport->SendTo(address, txBuffer);
+    }
+
+    std::shared_ptr<const ElementCatalog> catalog;
+    std::map<elementId_t, AgreementInformation> AgreementInformation_map;
+    // sorted
+    std::vector<elementId_t> nearbyElements;
+    std::map<nodeId_t, nodeEntry> localGroup;
+    nodeId_t node_id;
+    PeerTransport *transport;
+    // chunked transfers, keyed by (peer, element)
+    std::map<std::pair<nodeId_t, elementId_t>, OutgoingTransfer> outgoing;
+    std::map<std::pair<nodeId_t, elementId_t>, IncomingTransfer> incoming;
+    ChunkStore chunkStore;
+    // missing chunks that have arrived since RequestChunks last ran
+    uint32_t chunksSinceRequest = 0;
+    // see Rejoin. recoveringSince is -1 when not recovering
+    bool catchingUp = false;
+    int64_t recoveringSince = -1;
+    int64_t lastRecovery = -1;
+    int64_t lastDigest = INT64_MIN / 2;
+    // whether the nearby set has been worked out since Setup, and the address our beacons give
+    bool nearbyKnown = false;
+    uint32_t advertisedAddress = 0;
+    // bumped whenever our version/round of an element or our set of nearby elements changes,
+    // which is what decides whether a repeated advert needs comparing again
+    uint32_t stateGeneration = 0;
+    // the time in milliseconds and the sync epoch as of the last call in
+    int64_t now = 0;
+    uint32_t epoch = 0;
+    uint32_t selfConfirmedEpoch = UINT32_MAX;
+    // our advert entries as of ownAdvertGeneration
+    std::vector<uint8_t> ownAdvert;
+    uint32_t ownAdvertGeneration = UINT32_MAX;
+
+    // scratch space reused across messages so that steady-state handling does not allocate
+    std::vector<uint8_t> txBuffer;
+    std::vector<elementId_t> agree;
+    std::vector<elementId_t> candidates, nowNearby;
+    std::vector<causalKey_t> neighborKeys;
+    std::vector<nodeId_t> neighborIds;
+    std::vector<nodeId_t> pushTargets;
+    std::vector<std::pair<size_t, size_t>> pieces;
+    std::vector<chunkHash_t> hashes;
+    std::vector<nodeId_t> chunkHolders;
+    std::vector<uint8_t> syncBuffer;
+    std::vector<elementId_t> syncAcks, syncElements;
+    std::map<nodeId_t, std::vector<chunkHash_t>> chunkRequests;
+};
+
+// the number of elements that have converged across a set of peers: some peer is near the element,
+// and every peer near it holds the same version and round
+inline size_t CountConvergedElements(const std::vector<const PeerProtocol*> &peers) {
+    if(peers.empty()) {
+        return 0;
+    }
+    // per element: 0 while no peer near it has been seen, 1 while they all agree, 2 once they do not
+    std::vector<uint8_t> status(peers[0]->get_catalog().size(), 0);
+    std::vector<causalKey_t> keys(status.size());
+    for(const PeerProtocol *peer : peers) {
+        for(elementId_t element : peer->get_nearbyElements()) {
+            const AgreementInformation &info = peer->get_AgreementInformation().at(element);
+            causalKey_t theirs = causalKey(info.get_version(), info.get_round());
+            if(status[element] == 0) {
+                status[element] = 1;
+                keys[element] = theirs;
+            }
+            else if(keys[element] != theirs) {
+                status[element] = 2;
+            }
+        }
+    }
+    return std::count(status.begin(), status.end(), 1);
+}
+
+#endif
@@ -0,0 +1,248 @@
+// times the message codecs and agreement rules in peer_protocol.h on their own, without ns-3:
+//   g++ -std=c++17 -O2 -o protocol_bench protocol_bench.cpp && ./protocol_bench [filter]
+// prints one csv row per benchmark and size. n is the number of advertised elements for the
+// advert benchmarks, the number of peers for the sync group and best-peer ones, and the number of
+// bytes for payload_split. a filter
+// argument only runs the benchmarks whose name contains it. the exit status is nonzero if
+// advert_repeat is not under half the cost of advert_compare
+
+#include "peer_protocol.h"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+// swallows everything the peer under test sends
+class NullTransport : public PeerTransport {
+public:
+    void SendTo(uint32_t, const std::vector<uint8_t> &mesg) {
+        sent += mesg.size();
+    }
+    size_t sent = 0;
+};
+
+static const char *filter = nullptr;
+
+static bool Selected(const char *name) {
+    return filter == nullptr || std::strstr(name, filter) != nullptr;
+}
+
+static void Report(const char *name, size_t n, double ns) {
+    std::printf("%s,%zu,%.1f,%.0f\n", name, n, ns, 1e9 / ns);
+}
+
+// a catalog of n elements packed around the origin, so a peer there is near all of them
+static std::shared_ptr<const ElementCatalog> CatalogOf(size_t n) {
+    std::vector<std::pair<location_t, location_t>> locations;
+    for(size_t idx = 0; idx < n; idx++) {
+        locations.emplace_back((location_t)(idx % 64) * 0.01f, (location_t)(idx / 64) * 0.01f);
+    }
+    return std::make_shared<const ElementCatalog>(locations, 8.0f);
+}
+
+// n elements with made up state, and the list of them an advert would carry
+static void StateOf(size_t n, std::mt19937 &rng, std::map<elementId_t, AgreementInformation> *state, std::vector<elementId_t> *nearby) {
+    for(size_t idx = 0; idx < n; idx++) {
+        AgreementInformation info(std::pair<location_t, location_t>(1.0f, 2.0f), 0, 0, 6);
+        info.set_version(rng() & 0xFF);
+        info.set_round(rng() & 0xFF);
+        state->emplace((elementId_t)idx, info);
+        nearby->push_back((elementId_t)idx);
+    }
+}
+
+// an element whose sync group holds g peers at various ages
+static AgreementInformation GroupOf(size_t g, uint32_t epoch) {
+    AgreementInformation info(std::pair<location_t, location_t>(1.0f, 2.0f), 0, epoch, 6);
+    for(size_t n = 1; n < g; n++) {
+        info.add_agreeingNodes((nodeId_t)(n * 7919), epoch - (uint32_t)(n % 6));
+    }
+    info.add_agreeingNodes(0, epoch);
+    return info;
+}
+
+static void BenchAdvertCodec(std::mt19937 &rng) {
+    for(size_t n : {16, 256, 4096}) {
+        std::map<elementId_t, AgreementInformation> state;
+        std::vector<elementId_t> nearby;
+        StateOf(n, rng, &state, &nearby);
+        std::vector<uint8_t> mesg;
+        mesg.reserve(ADVERT_Message::headerSize + n*PackedAdvertEntries::entrySize);
+
+        if(Selected("advert_serialize")) {
+            Report("advert_serialize", n, TimeCalls([&]() {
+                ADVERT_Message::serialize(1, 0x0A010101, nearby, state, &mesg);
+                KeepResult(mesg);
+            }));
+        }
+        ADVERT_Message::serialize(1, 0x0A010101, nearby, state, &mesg);
+        // deserializing only lays a view over the buffer, so this also decodes every entry
+        if(Selected("advert_deserialize")) {
+            Report("advert_deserialize", n, TimeCalls([&]() {
+                ADVERT_Message m;
+                ADVERT_Message::deserialize(mesg.data(), mesg.size(), &m);
+                uint32_t sum = 0;
+                for(size_t idx = 0; idx < m.entries.size(); idx++) {
+                    sum += m.entries.element(idx) + m.entries.version(idx) + m.entries.round(idx);
+                }
+                KeepResult(sum);
+            }));
+        }
+    }
+}
+
+static void BenchSendDataCodec() {
+    const uint32_t epoch = 100;
+    for(size_t g : {4, 32, 256}) {
+        AgreementInformation info = GroupOf(g, epoch);
+        std::vector<uint8_t> mesg;
+        mesg.reserve(SEND_DATA_Message::headerSize + g*PackedMembers::memberSize);
+
+        if(Selected("send_data_serialize")) {
+            Report("send_data_serialize", g, TimeCalls([&]() {
+                SEND_DATA_Message::serialize(1, 42, info, epoch, &mesg);
+                KeepResult(mesg);
+            }));
+        }
+        SEND_DATA_Message::serialize(1, 42, info, epoch, &mesg);
+        if(Selected("send_data_deserialize")) {
+            Report("send_data_deserialize", g, TimeCalls([&]() {
+                SEND_DATA_Message m;
+                SEND_DATA_Message::deserialize(mesg.data(), mesg.size(), &m);
+                uint32_t sum = m.version + m.round;
+                for(size_t idx = 0; idx < m.sync_group.size(); idx++) {
+                    sum += m.sync_group.id(idx) + m.sync_group.age(idx);
+                }
+                KeepResult(sum);
+            }));
+        }
+
+        // what a receiver does with the sync group: replace its own with the sender's, then join
+        if(Selected("sync_merge")) {
+            SEND_DATA_Message m;
+            SEND_DATA_Message::deserialize(mesg.data(), mesg.size(), &m);
+            AgreementInformation ours = GroupOf(g / 2 + 1, epoch);
+            Report("sync_merge", g, TimeCalls([&]() {
+                ours.set_agreeingNodes(m.sync_group, epoch);
+                ours.add_agreeingNodes(12345, epoch);
+                KeepResult(ours);
+            }));
+        }
+    }
+}
+
+// a peer near n elements receives adverts from a neighbor over the same elements. the neighbor
+// is never ahead, so nothing is requested; advert_compare changes one entry between adverts so
+// every one is compared in full, advert_repeat sends the same one and takes the fast path.
+// when both run, returns false unless the repeat costs less than half of a full compare
+static bool BenchAdvertCompare() {
+    bool fastPath = true;
+    for(size_t n : {16, 256, 4096}) {
+        if(!Selected("advert_compare") && !Selected("advert_repeat")) {
+            return fastPath;
+        }
+        NullTransport transport;
+        PeerProtocol peer;
+        peer.Setup(0, &transport, CatalogOf(n));
+        peer.nearbyDistance = 1000.0f;
+        peer.UpdateNearbyElements(0.0f, 0.0f, 0);
+
+        std::vector<uint8_t> adverts[2];
+        for(std::vector<uint8_t> &mesg : adverts) {
+            mesg.push_back(ADVERT);
+            fourByteToOne(1, &mesg);
+            fourByteToOne(0x0A010102, &mesg);
+            for(size_t idx = 0; idx < n; idx++) {
+                twoByteToOne((elementId_t)idx, &mesg);
+                mesg.push_back(0);
+                mesg.push_back(0);
+            }
+        }
+        adverts[1][ADVERT_Message::headerSize + 3] = 1;
+
+        size_t turn = 0;
+        double compare = 0, repeat = 0;
+        if(Selected("advert_compare")) {
+            compare = TimeCalls([&]() {
+                const std::vector<uint8_t> &mesg = adverts[turn++ & 1];
+                peer.ReceiveMessage(mesg.data(), mesg.size(), 0);
+            });
+            Report("advert_compare", n, compare);
+        }
+        if(Selected("advert_repeat")) {
+            repeat = TimeCalls([&]() {
+                peer.ReceiveMessage(adverts[0].data(), adverts[0].size(), 0);
+            });
+            Report("advert_repeat", n, repeat);
+        }
+        if(compare > 0 && repeat > 0 && repeat * 2 > compare) {
+            std::fprintf(stderr, "advert_repeat at n=%zu costs %.1f ns, not clearly cheaper than advert_compare at %.1f ns\n", n, repeat, compare);
+            fastPath = false;
+        }
+    }
+    return fastPath;
+}
+
+// picking the neighbor to pull an element from, among g neighbors that advertised it
+static void BenchBestPeer(std::mt19937 &rng) {
+    if(!Selected("best_peer")) {
+        return;
+    }
+    for(size_t g : {4, 32, 256}) {
+        NullTransport transport;
+        PeerProtocol peer;
+        peer.Setup(0, &transport, CatalogOf(1));
+        std::vector<uint8_t> mesg;
+        for(size_t n = 1; n <= g; n++) {
+            mesg.clear();
+            mesg.push_back(ADVERT);
+            fourByteToOne((nodeId_t)n, &mesg);
+            fourByteToOne(0x0A010101 + (uint32_t)n, &mesg);
+            twoByteToOne(0, &mesg);
+            mesg.push_back(0);
+            mesg.push_back(rng() & 0xFF);
+            peer.ReceiveMessage(mesg.data(), mesg.size(), 0);
+        }
+        Report("best_peer", g, TimeCalls([&]() {
+            peer.BeginAgreement(0);
+        }));
+    }
+}
+
+// cutting a payload into content-defined chunks and hashing them, as SetPayload does. n is the
+// payload size in bytes
+static void BenchPayloadSplit(std::mt19937 &rng) {
+    if(!Selected("payload_split")) {
+        return;
+    }
+    for(size_t n : {4096, 65536, 1048576}) {
+        std::vector<uint8_t> data(n);
+        for(uint8_t &b : data) {
+            b = rng() & 0xFF;
+        }
+        std::vector<std::pair<size_t, size_t>> pieces;
+        Report("payload_split", n, TimeCalls([&]() {
+            pieces.clear();
+            SplitPayload(data.data(), data.size(), 1024, 1459, &pieces);
+            uint64_t sum = 0;
+            for(const auto &piece : pieces) {
+                sum += digestBytes(data.data() + piece.first, piece.second);
+            }
+            KeepResult(sum);
+        }));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    filter = argc > 1 ? argv[1] : nullptr;
+    std::mt19937 rng(525);
+
+    std::printf("benchmark,n,ns_per_op,ops_per_sec\n");
+    BenchAdvertCodec(rng);
+    BenchSendDataCodec();
+    bool fastPath = BenchAdvertCompare();
+    BenchBestPeer(rng);
+    BenchPayloadSplit(rng);
+    return fastPath ? 0 : 1;
+}
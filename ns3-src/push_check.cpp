@@ -0,0 +1,127 @@
+// checks that push dissemination goes quiet once a group agrees. eight peers in range of each
+// other share a few elements with pushing on; every message a beacon sets off is delivered in a
+// random order, so pushed states cross each other the way they do on a real radio. once every
+// peer holds the same version and round of every element, further beacons must not set off a
+// single SEND_DATA. the same is checked again after peer 0 writes new data and the write spreads.
+//
+// this does not need ns-3:
+//   g++ -std=c++17 -O2 -o push_check push_check.cpp && ./push_check
+// the exit status is nonzero if the group fails to agree, or sends SEND_DATA after it has
+
+#include "peer_protocol.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+static const uint32_t baseAddress = 0x0A010101;
+static const size_t numNodes = 8;
+static const size_t numElements = 4;
+
+struct Delivery {
+    uint32_t to;
+    std::vector<uint8_t> mesg;
+};
+
+static std::vector<Delivery> inFlight;
+static size_t sendData = 0;
+static std::mt19937 rng(525);
+
+class QueueTransport : public PeerTransport {
+public:
+    void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+        sendData += mesg[0] == SEND_DATA || mesg[0] == SEND_DATA_CHUNK;
+        inFlight.push_back(Delivery{address - baseAddress, mesg});
+    }
+};
+
+static PeerProtocol peers[numNodes];
+static QueueTransport transports[numNodes];
+static int64_t now = 0;
+
+// one second of beacons. everything they set off, and everything that sets off in turn, is
+// delivered in a random order before the second ends
+static void Run() {
+    now += 1000;
+    for(size_t n = 0; n < numNodes; n++) {
+        peers[n].UpdateNearbyElements(0.0f, 0.0f, now);
+        for(size_t part = 0, parts = peers[n].AdvertisementParts(); part < parts; part++) {
+            std::vector<uint8_t> mesg = peers[n].BuildAdvertisement(baseAddress + n, part);
+            for(size_t to = 0; to < numNodes; to++) {
+                if(to != n) {
+                    peers[to].ReceiveMessage(mesg.data(), mesg.size(), now);
+                }
+            }
+        }
+    }
+    while(!inFlight.empty()) {
+        std::swap(inFlight[rng() % inFlight.size()], inFlight.back());
+        Delivery d = std::move(inFlight.back());
+        inFlight.pop_back();
+        peers[d.to].ReceiveMessage(d.mesg.data(), d.mesg.size(), now);
+    }
+    for(size_t n = 0; n < numNodes; n++) {
+        peers[n].CheckTransfers(now);
+    }
+}
+
+// every peer holds the same version and round of every element
+static bool Agreed() {
+    for(elementId_t element = 0; element < numElements; element++) {
+        const AgreementInformation *first = nullptr;
+        for(const PeerProtocol &peer : peers) {
+            auto it = peer.get_AgreementInformation().find(element);
+            if(it == peer.get_AgreementInformation().end()) {
+                return false;
+            }
+            const AgreementInformation &info = it->second;
+            if(first == nullptr) {
+                first = &info;
+            }
+            if(info.get_version() != first->get_version() || info.get_round() != first->get_round()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// runs until the group agrees, then for quietSeconds more. false if it never agreed or sent
+// SEND_DATA after agreeing
+static bool Settle(const char *phase) {
+    const int limit = 60, quietSeconds = 20;
+    sendData = 0;
+    int seconds = 0;
+    while(seconds < limit && !Agreed()) {
+        Run();
+        seconds++;
+    }
+    size_t before = sendData;
+    sendData = 0;
+    for(int s = 0; s < quietSeconds; s++) {
+        Run();
+    }
+    std::printf("%s: agreed after %d s and %zu SEND_DATA, then %zu SEND_DATA in %d s\n",
+        phase, seconds, before, sendData, quietSeconds);
+    return Agreed() && sendData == 0;
+}
+
+int main() {
+    std::vector<std::pair<location_t, location_t>> locations;
+    for(size_t idx = 0; idx < numElements; idx++) {
+        locations.push_back(std::pair<location_t, location_t>(1.0f * idx, 0.0f));
+    }
+    auto catalog = std::make_shared<const ElementCatalog>(locations, 8.0f);
+    for(size_t n = 0; n < numNodes; n++) {
+        peers[n].Setup(n, &transports[n], catalog);
+        peers[n].locationNoiseRange = 0.0f;
+        peers[n].pushFanout = 3;
+        peers[n].pushRandom = []() { return std::uniform_real_distribution<double>(0.0, 1.0)(rng); };
+    }
+
+    bool pass = Settle("start");
+    std::vector<uint8_t> data(2048, 7);
+    pass = peers[0].SetPayload(0, data.data(), data.size(), now) && pass;
+    pass = Settle("after a write") && pass;
+    return pass ? 0 : 1;
+}
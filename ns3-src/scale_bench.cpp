@@ -0,0 +1,374 @@
+// measures how the cost of simulating the peer-node scenario grows with the number of nodes and
+// elements. it runs the scenario from peer_node.cpp on a small event queue of its own instead of
+// ns-3, so that what is measured is the protocol and the simulation around it rather than the wifi
+// model:
+//   g++ -std=c++17 -O2 -o scale_bench scale_bench.cpp && ./scale_bench --baseline=scale_baseline.csv
+//
+// this measures the protocol and the scenario around it alone: ns-3, the wifi model and the
+// sockets are not part of the wall time. peer_node.cpp scales the same way with --nodes,
+// --elements and --areaSide and logs its own wall time and events/s, for the cost with them.
+//
+// the scenario keeps the density of peer_node.cpp: nodes sit still at random positions on a square
+// that grows with the node count (3 nodes per 10x10), and elements are spread over the same square.
+// beacons reach every node within 10 m, unicast always arrives, everything takes 1 ms. each node
+// beacons and checks for nearby elements every second, prunes its local group every 3 s and retries
+// chunks every 200 ms, from a random start in the first second until 13 s.
+//
+// each configuration runs in its own process so that its peak resident memory is its own. one csv
+// row is printed per configuration, with the wall time spent in each part of the simulation:
+// building and fanning out beacons, handling received messages, finding nearby elements and the
+// periodic timers. whatever is left over is setup and the event queue itself.
+//
+// the regression gate is opt-in. with --baseline the wall time is compared against a stored run,
+// and the exit status is nonzero if any configuration that takes at least 50 ms got slower than
+// --tolerance times its baseline. both are first divided by the time a fixed calibration workload
+// takes on the machine at hand (see Calibrate), so a baseline stored on one machine is roughly
+// comparable on another. that only goes so far, since cache sizes and memory speed do not scale
+// alike; on a machine that differs a lot, store a baseline of its own with --write-baseline=<file>
+// before changing anything and compare against that
+//
+// other options: --nodes=10,100,... --elements=5,500,... --seconds=13
+
+#include "peer_protocol.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+
+struct Result {
+    uint32_t nodes, elements;
+    double wall;
+    uint64_t events, packets;
+    long peakKb;
+    uint64_t converged;
+    double beacon, receive, nearby, timers;
+};
+
+static const uint32_t baseAddress = 0x0A010101;
+static const float beaconRange = 10.0f;
+static const int64_t delay = 1;
+
+class Scenario {
+public:
+    enum Kind : uint8_t { BEACON, DELIVER, NEARBY, HEARTBEAT, TRANSFERS };
+
+    struct Event {
+        int64_t time;
+        uint64_t seq;
+        Kind kind;
+        uint32_t node;
+        std::shared_ptr<const std::vector<uint8_t>> mesg;
+        bool operator<(const Event &o) const { return time > o.time || (time == o.time && seq > o.seq); }
+    };
+
+    class Transport : public PeerTransport {
+    public:
+        void SendTo(uint32_t address, const std::vector<uint8_t> &mesg) {
+            scenario->Schedule(scenario->now + delay, DELIVER, address - baseAddress, std::make_shared<const std::vector<uint8_t>>(mesg));
+            scenario->packets++;
+        }
+        Scenario *scenario;
+    };
+
+    Scenario(uint32_t nodes, uint32_t elements, uint32_t seed): peers(nodes), transports(nodes), positions(nodes), neighbors(nodes) {
+        std::mt19937 rng(seed);
+        float side = 10.0f * std::sqrt(nodes / 3.0f);
+        std::uniform_real_distribution<float> coordinate(0.0f, side);
+        std::vector<std::pair<location_t, location_t>> locations;
+        for(uint32_t e = 0; e < elements; e++) {
+            float x = coordinate(rng);
+            locations.emplace_back(x, coordinate(rng));
+        }
+        catalog = std::make_shared<const ElementCatalog>(locations, 8.0f);
+        for(uint32_t n = 0; n < nodes; n++) {
+            float x = coordinate(rng);
+            positions[n] = std::make_pair(x, coordinate(rng));
+        }
+
+        // nodes do not move, so who hears whose beacons is worked out once, bucketed by beacon range
+        std::map<std::pair<int32_t, int32_t>, std::vector<uint32_t>> cells;
+        for(uint32_t n = 0; n < nodes; n++) {
+            cells[CellOf(n)].push_back(n);
+        }
+        for(uint32_t n = 0; n < nodes; n++) {
+            std::pair<int32_t, int32_t> cell = CellOf(n);
+            for(int32_t i = cell.first - 1; i <= cell.first + 1; i++) {
+                for(int32_t j = cell.second - 1; j <= cell.second + 1; j++) {
+                    auto it = cells.find(std::make_pair(i, j));
+                    if(it == cells.end()) {
+                        continue;
+                    }
+                    for(uint32_t m : it->second) {
+                        float dx = positions[m].first - positions[n].first;
+                        float dy = positions[m].second - positions[n].second;
+                        if(m != n && dx*dx + dy*dy <= beaconRange*beaconRange) {
+                            neighbors[n].push_back(m);
+                        }
+                    }
+                }
+            }
+        }
+
+        std::uniform_int_distribution<int64_t> start(0, 999);
+        for(uint32_t n = 0; n < nodes; n++) {
+            transports[n].scenario = this;
+            peers[n].Setup(n, &transports[n], catalog);
+            int64_t at = start(rng);
+            Schedule(at + 1000, BEACON, n);
+            Schedule(at + 1000, NEARBY, n);
+            Schedule(at + 3000, HEARTBEAT, n);
+            Schedule(at + peers[n].chunkRetryTimeout, TRANSFERS, n);
+        }
+    }
+
+    void Run(int64_t until, Result *r) {
+        while(!queue.empty() && queue.top().time <= until) {
+            Event e = queue.top();
+            queue.pop();
+            now = e.time;
+            events++;
+            auto begin = std::chrono::steady_clock::now();
+            double *bucket = nullptr;
+            PeerProtocol &peer = peers[e.node];
+            switch(e.kind) {
+            case BEACON:
+                for(size_t part = 0, parts = peer.AdvertisementParts(); part < parts; part++) {
+                    auto mesg = std::make_shared<const std::vector<uint8_t>>(peer.BuildAdvertisement(baseAddress + e.node, part));
+                    for(uint32_t m : neighbors[e.node]) {
+                        Schedule(now + delay, DELIVER, m, mesg);
+                        packets++;
+                    }
+                }
+                Schedule(now + 1000, BEACON, e.node);
+                bucket = &r->beacon;
+                break;
+            case DELIVER:
+                peer.ReceiveMessage(e.mesg->data(), e.mesg->size(), now);
+                bucket = &r->receive;
+                break;
+            case NEARBY:
+                peer.UpdateNearbyElements(positions[e.node].first, positions[e.node].second, now);
+                Schedule(now + 1000, NEARBY, e.node);
+                bucket = &r->nearby;
+                break;
+            case HEARTBEAT:
+                peer.CheckHeartbeats(now);
+                Schedule(now + 3000, HEARTBEAT, e.node);
+                bucket = &r->timers;
+                break;
+            case TRANSFERS:
+                peer.CheckTransfers(now);
+                Schedule(now + peer.chunkRetryTimeout, TRANSFERS, e.node);
+                bucket = &r->timers;
+                break;
+            }
+            *bucket += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+        r->events = events;
+        r->packets = packets;
+    }
+
+    uint64_t Converged() const {
+        std::vector<const PeerProtocol*> all;
+        for(const PeerProtocol &peer : peers) {
+            all.push_back(&peer);
+        }
+        return CountConvergedElements(all);
+    }
+
+private:
+    std::pair<int32_t, int32_t> CellOf(uint32_t n) const {
+        return std::make_pair((int32_t)std::floor(positions[n].first / beaconRange), (int32_t)std::floor(positions[n].second / beaconRange));
+    }
+
+    void Schedule(int64_t time, Kind kind, uint32_t node, std::shared_ptr<const std::vector<uint8_t>> mesg = nullptr) {
+        queue.push(Event{time, seq++, kind, node, std::move(mesg)});
+    }
+
+    std::vector<PeerProtocol> peers;
+    std::vector<Transport> transports;
+    std::vector<std::pair<location_t, location_t>> positions;
+    std::vector<std::vector<uint32_t>> neighbors;
+    std::shared_ptr<const ElementCatalog> catalog;
+    std::priority_queue<Event> queue;
+    uint64_t seq = 0;
+    int64_t now = 0;
+    uint64_t events = 0, packets = 0;
+};
+
+// a fixed workload of the kinds the scenario is made of: map inserts and lookups, hashing buffers
+// the size of a datagram and sorting. the fastest of three runs, in seconds
+static double Calibrate() {
+    double best = 0;
+    volatile uint64_t sink = 0;
+    for(int rep = 0; rep < 3; rep++) {
+        auto begin = std::chrono::steady_clock::now();
+        std::mt19937 rng(525);
+        std::map<uint32_t, uint32_t> counts;
+        std::vector<uint8_t> buf(1472);
+        uint64_t sum = 0;
+        for(uint32_t i = 0; i < 400000; i++) {
+            counts[rng() % 65536] += i;
+            buf[i % buf.size()] = (uint8_t)i;
+            if(i % 16 == 0) {
+                sum += digestBytes(buf.data(), buf.size());
+            }
+        }
+        std::vector<uint32_t> values(1 << 20);
+        for(uint32_t &v : values) {
+            v = rng();
+        }
+        std::sort(values.begin(), values.end());
+        sink = sink + sum + counts.size() + values[0];
+        double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        best = rep == 0 ? took : std::min(best, took);
+    }
+    return best;
+}
+
+// runs one configuration in a child process and collects its results and peak memory
+static bool RunIsolated(uint32_t nodes, uint32_t elements, int64_t until, Result *r) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return false;
+    }
+    pid_t child = fork();
+    if(child == 0) {
+        close(fds[0]);
+        Result mine{};
+        mine.nodes = nodes;
+        mine.elements = elements;
+        auto begin = std::chrono::steady_clock::now();
+        Scenario scenario(nodes, elements, 525);
+        scenario.Run(until, &mine);
+        mine.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        mine.converged = scenario.Converged();
+        ssize_t written = write(fds[1], &mine, sizeof(mine));
+        _exit(written == (ssize_t)sizeof(mine) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], r, sizeof(*r));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if(child < 0 || wait4(child, &status, 0, &usage) != child || got != (ssize_t)sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return false;
+    }
+    r->peakKb = usage.ru_maxrss;
+    return true;
+}
+
+static std::vector<uint32_t> ParseList(const char *s) {
+    std::vector<uint32_t> values;
+    std::stringstream in(s);
+    std::string item;
+    while(std::getline(in, item, ',')) {
+        values.push_back((uint32_t)std::stoul(item));
+    }
+    return values;
+}
+
+// baseline normalized wall times (see Calibrate) by (nodes, elements), read from an earlier run's csv
+static std::map<std::pair<uint32_t, uint32_t>, double> ReadBaseline(const std::string &path) {
+    std::map<std::pair<uint32_t, uint32_t>, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)) {
+        uint32_t nodes, elements;
+        double wall;
+        if(std::sscanf(line.c_str(), "%u,%u,%lf", &nodes, &elements, &wall) == 3) {
+            baseline[std::make_pair(nodes, elements)] = wall;
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<uint32_t> nodeCounts{10, 100, 1000, 10000};
+    std::vector<uint32_t> elementCounts{5, 500, 50000};
+    double seconds = 13;
+    double tolerance = 1.25;
+    std::string baselinePath, writeBaseline;
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if(std::strncmp(arg, "--nodes=", 8) == 0) {
+            nodeCounts = ParseList(arg + 8);
+        }
+        else if(std::strncmp(arg, "--elements=", 11) == 0) {
+            elementCounts = ParseList(arg + 11);
+        }
+        else if(std::strncmp(arg, "--seconds=", 10) == 0) {
+            seconds = std::atof(arg + 10);
+        }
+        else if(std::strncmp(arg, "--tolerance=", 12) == 0) {
+            tolerance = std::atof(arg + 12);
+        }
+        else if(std::strncmp(arg, "--baseline=", 11) == 0) {
+            baselinePath = arg + 11;
+        }
+        else if(std::strncmp(arg, "--write-baseline=", 17) == 0) {
+            writeBaseline = arg + 17;
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return 2;
+        }
+    }
+
+    std::map<std::pair<uint32_t, uint32_t>, double> baseline;
+    if(!baselinePath.empty()) {
+        baseline = ReadBaseline(baselinePath);
+    }
+    std::ofstream store;
+    if(!writeBaseline.empty()) {
+        store.open(writeBaseline);
+        store << "nodes,elements,normalized_wall\n";
+    }
+    double calibration = Calibrate();
+    std::fprintf(stderr, "calibration workload: %.3f s\n", calibration);
+
+    bool regressed = false;
+    std::printf("nodes,elements,wall_s,events,events_per_s,packets,packets_per_s,peak_rss_kb,converged,beacon_s,receive_s,nearby_s,timer_s,queue_s,normalized_wall,baseline_normalized_wall,vs_baseline\n");
+    for(uint32_t nodes : nodeCounts) {
+        for(uint32_t elements : elementCounts) {
+            Result r;
+            if(!RunIsolated(nodes, elements, (int64_t)(seconds * 1000), &r)) {
+                std::fprintf(stderr, "run with %u nodes and %u elements failed\n", nodes, elements);
+                return 2;
+            }
+            double queueTime = std::max(0.0, r.wall - r.beacon - r.receive - r.nearby - r.timers);
+            std::printf("%u,%u,%.3f,%llu,%.0f,%llu,%.0f,%ld,%llu,%.3f,%.3f,%.3f,%.3f,%.3f", nodes, elements, r.wall,
+                (unsigned long long)r.events, r.events / r.wall, (unsigned long long)r.packets, r.packets / r.wall,
+                r.peakKb, (unsigned long long)r.converged, r.beacon, r.receive, r.nearby, r.timers, queueTime);
+            double normalized = r.wall / calibration;
+            std::printf(",%.4f", normalized);
+            auto base = baseline.find(std::make_pair(nodes, elements));
+            if(base != baseline.end()) {
+                // runs this short are mostly timer noise
+                double ratio = normalized / base->second;
+                bool slower = ratio > tolerance && r.wall >= 0.05;
+                std::printf(",%.4f,%.2f%s\n", base->second, ratio, slower ? " SLOWER" : "");
+                regressed = regressed || slower;
+            }
+            else {
+                std::printf(",,\n");
+            }
+            std::fflush(stdout);
+            if(store.is_open()) {
+                store << nodes << "," << elements << "," << normalized << "\n";
+            }
+        }
+    }
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+// SHA-256 (FIPS 180-4), for naming payload chunks by their content. self-contained so the protocol
+// core still builds with nothing but a compiler. not written to be fast: chunks are hashed once
+// when written and once when they arrive
+
+#include <cstddef>
+#include <cstdint>
+
+class Sha256 {
+public:
+    Sha256(): length(0), used(0) {
+        static const uint32_t init[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        for(int idx = 0; idx < 8; idx++) {
+            state[idx] = init[idx];
+        }
+    }
+
+    void Update(const uint8_t *data, size_t len) {
+        length += len;
+        while(len > 0) {
+            size_t take = 64 - used < len ? 64 - used : len;
+            for(size_t idx = 0; idx < take; idx++) {
+                block[used + idx] = data[idx];
+            }
+            used += take;
+            data += take;
+            len -= take;
+            if(used == 64) {
+                Compress();
+                used = 0;
+            }
+        }
+    }
+
+    // pads what has been hashed so far and writes the 32 byte digest
+    void Final(uint8_t out[32]) {
+        uint64_t bits = length * 8;
+        uint8_t pad = 0x80;
+        Update(&pad, 1);
+        pad = 0;
+        while(used != 56) {
+            Update(&pad, 1);
+        }
+        for(int idx = 7; idx >= 0; idx--) {
+            block[used++] = (uint8_t)(bits >> (8*idx));
+        }
+        Compress();
+        for(int idx = 0; idx < 8; idx++) {
+            out[4*idx] = (uint8_t)(state[idx] >> 24);
+            out[4*idx + 1] = (uint8_t)(state[idx] >> 16);
+            out[4*idx + 2] = (uint8_t)(state[idx] >> 8);
+            out[4*idx + 3] = (uint8_t)state[idx];
+        }
+    }
+
+private:
+    static uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void Compress() {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        uint32_t w[64];
+        for(int idx = 0; idx < 16; idx++) {
+            w[idx] = (uint32_t)block[4*idx] << 24 | (uint32_t)block[4*idx + 1] << 16 | (uint32_t)block[4*idx + 2] << 8 | block[4*idx + 3];
+        }
+        for(int idx = 16; idx < 64; idx++) {
+            uint32_t s0 = Rotr(w[idx - 15], 7) ^ Rotr(w[idx - 15], 18) ^ (w[idx - 15] >> 3);
+            uint32_t s1 = Rotr(w[idx - 2], 17) ^ Rotr(w[idx - 2], 19) ^ (w[idx - 2] >> 10);
+            w[idx] = w[idx - 16] + s0 + w[idx - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for(int idx = 0; idx < 64; idx++) {
+            uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[idx] + w[idx];
+            uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#!/bin/bash
+# compiles every program in this directory without linking, so a change that breaks one of them
+# shows up without ns-3 installed. peer_node.cpp and edge_node.cpp are built against the stubs in
+# ns3-stub/, which only declare the parts of ns-3 they use; the standalone drivers need nothing.
+#   ./syntax_check.sh
+# the exit status is nonzero if any file failed to compile
+cd "$(dirname "$0")"
+status=0
+for src in peer_node.cpp edge_node.cpp; do
+    g++ -std=c++17 -fsyntax-only -Wall -Ins3-stub "$src" || status=1
+done
+for src in alloc_count.cpp payload_check.cpp push_check.cpp protocol_bench.cpp advert_bench.cpp scale_bench.cpp pcap_replay.cpp; do
+    g++ -std=c++17 -fsyntax-only -Wall -Wextra "$src" || status=1
+done
+exit $status